@@ -0,0 +1,346 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+#include "process_queries.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// mt19937_64 выдаёт одну и ту же последовательность в любой стандартной
+// библиотеке, а распределения из <random> — нет, поэтому числа из него
+// переводятся в нужный диапазон вручную.
+double GetUniform(std::mt19937_64& generator) {
+    return static_cast<double>(generator() >> 11) * (1.0 / static_cast<double>(uint64_t{1} << 53));
+}
+
+size_t GetUniform(std::mt19937_64& generator, size_t min, size_t max) {
+    return min + static_cast<size_t>(generator() % (max - min + 1));
+}
+
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t size, double skew)
+        : cumulative_weights_(size)
+    {
+        double sum = 0.0;
+        for (size_t rank = 0; rank < size; ++rank) {
+            sum += 1.0 / std::pow(static_cast<double>(rank + 1), skew);
+            cumulative_weights_[rank] = sum;
+        }
+    }
+
+    // Ранг слова, начиная с нуля.
+    size_t operator()(std::mt19937_64& generator) const {
+        const double point = GetUniform(generator) * cumulative_weights_.back();
+        const auto it = std::upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), point);
+        return std::min(static_cast<size_t>(it - cumulative_weights_.begin()), cumulative_weights_.size() - 1);
+    }
+
+private:
+    std::vector<double> cumulative_weights_;
+};
+
+// Биективная запись в 26-ричной системе: a, b, ..., z, aa, ab, ... Частые
+// слова получаются короче, как и в настоящих текстах.
+std::string MakeWord(size_t rank) {
+    std::string word;
+    for (size_t value = rank + 1; value > 0; value = (value - 1) / 26) {
+        word.push_back(static_cast<char>('a' + (value - 1) % 26));
+    }
+    return word;
+}
+
+void CheckCorpusOptions(const CorpusOptions& options) {
+    if (options.vocabulary_size <= options.stop_word_count) {
+        throw std::invalid_argument("Vocabulary must contain words besides stop words"s);
+    }
+    if (options.min_document_length == 0 || options.min_document_length > options.max_document_length) {
+        throw std::invalid_argument("Invalid document length range"s);
+    }
+    if (!(options.zipf_skew >= 0.0)) {
+        throw std::invalid_argument("Zipf skew must be non-negative"s);
+    }
+    if (std::any_of(options.status_weights.begin(), options.status_weights.end(), [](double weight) { return !(weight >= 0.0); })
+        || std::accumulate(options.status_weights.begin(), options.status_weights.end(), 0.0) <= 0.0) {
+        throw std::invalid_argument("Status weights must be non-negative and not all zero"s);
+    }
+}
+
+DocumentStatus GetRandomStatus(std::mt19937_64& generator, const std::array<double, 4>& weights) {
+    double point = GetUniform(generator) * std::accumulate(weights.begin(), weights.end(), 0.0);
+    for (size_t status = 0; status + 1 < weights.size(); ++status) {
+        if (point < weights[status]) {
+            return static_cast<DocumentStatus>(status);
+        }
+        point -= weights[status];
+    }
+    return DocumentStatus::REMOVED;
+}
+
+std::chrono::nanoseconds GetPercentile(const std::vector<Clock::duration>& sorted_latencies, double fraction) {
+    if (sorted_latencies.empty()) {
+        return std::chrono::nanoseconds{0};
+    }
+    const size_t rank = std::max<size_t>(1, static_cast<size_t>(std::ceil(fraction * sorted_latencies.size())));
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(sorted_latencies[rank - 1]);
+}
+
+// operation(i) выполняет i-й вызов и возвращает пару из числа обработанных
+// элементов и числа результатов.
+template <typename Operation>
+BenchmarkResult Measure(std::string name, size_t call_count, Operation operation) {
+    BenchmarkResult result;
+    result.name = std::move(name);
+    std::vector<Clock::duration> latencies;
+    latencies.reserve(call_count);
+    for (size_t i = 0; i < call_count; ++i) {
+        const Clock::time_point start = Clock::now();
+        const auto [item_count, result_count] = operation(i);
+        latencies.push_back(Clock::now() - start);
+        result.item_count += item_count;
+        result.result_count += result_count;
+    }
+    const Clock::duration total_time = std::accumulate(latencies.begin(), latencies.end(), Clock::duration{0});
+    result.total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(total_time);
+    if (total_time > Clock::duration{0}) {
+        result.items_per_second = result.item_count / std::chrono::duration<double>(total_time).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    result.latency_p50 = GetPercentile(latencies, 0.5);
+    result.latency_p99 = GetPercentile(latencies, 0.99);
+    result.process_peak_rss_kb = GetPeakRssKb();
+    return result;
+}
+
+size_t GetBatchCount(size_t item_count, size_t batch_size) {
+    return (item_count + batch_size - 1) / batch_size;
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureAddDocuments(const std::string& name, ExecutionPolicy& policy, SearchServer& search_server,
+                                    const std::vector<NewDocument>& documents, size_t batch_size) {
+    return Measure(name, GetBatchCount(documents.size(), batch_size), [&](size_t batch) {
+        const auto first = documents.begin() + batch * batch_size;
+        const auto last = documents.begin() + std::min(documents.size(), (batch + 1) * batch_size);
+        search_server.AddDocuments(policy, std::vector<NewDocument>(first, last));
+        return std::pair(static_cast<size_t>(last - first), size_t{0});
+    });
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureFindTopDocuments(const std::string& name, ExecutionPolicy& policy, const SearchServer& search_server,
+                                        const std::vector<std::string>& queries) {
+    return Measure(name, queries.size(), [&](size_t i) {
+        return std::pair(size_t{1}, search_server.FindTopDocuments(policy, queries[i]).size());
+    });
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureMatchDocument(const std::string& name, ExecutionPolicy& policy, const SearchServer& search_server,
+                                     const std::vector<std::string>& queries, const std::vector<int>& document_ids) {
+    return Measure(name, document_ids.size(), [&](size_t i) {
+        const auto [words, status] = search_server.MatchDocument(policy, queries[i], document_ids[i]);
+        return std::pair(size_t{1}, words.size());
+    });
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult MeasureRemoveDocument(const std::string& name, ExecutionPolicy& policy, SearchServer& search_server,
+                                      const std::vector<int>& document_ids) {
+    return Measure(name, document_ids.size(), [&](size_t i) {
+        search_server.RemoveDocument(policy, document_ids[i]);
+        return std::pair(size_t{1}, size_t{0});
+    });
+}
+
+} // namespace
+
+std::vector<NewDocument> Corpus::GetNewDocuments() const {
+    std::vector<NewDocument> new_documents;
+    new_documents.reserve(documents.size());
+    for (const GeneratedDocument& document : documents) {
+        new_documents.push_back({document.id, document.text, document.status, document.ratings});
+    }
+    return new_documents;
+}
+
+Corpus GenerateCorpus(const CorpusOptions& options) {
+    CheckCorpusOptions(options);
+    std::mt19937_64 generator(options.seed);
+    const ZipfDistribution zipf(options.vocabulary_size, options.zipf_skew);
+
+    Corpus corpus;
+    for (size_t rank = 0; rank < options.stop_word_count; ++rank) {
+        corpus.stop_words += (rank == 0 ? ""s : " "s) + MakeWord(rank);
+    }
+    corpus.documents.reserve(options.document_count);
+    for (size_t i = 0; i < options.document_count; ++i) {
+        GeneratedDocument document{static_cast<int>(i + 1), {}, DocumentStatus::ACTUAL, {}};
+        const size_t length = GetUniform(generator, options.min_document_length, options.max_document_length);
+        for (size_t word = 0; word < length; ++word) {
+            if (word > 0) {
+                document.text.push_back(' ');
+            }
+            document.text += MakeWord(zipf(generator));
+        }
+        document.status = GetRandomStatus(generator, options.status_weights);
+        const size_t rating_count = GetUniform(generator, 1, 5);
+        for (size_t rating = 0; rating < rating_count; ++rating) {
+            document.ratings.push_back(static_cast<int>(GetUniform(generator, 0, 20)) - 10);
+        }
+        corpus.documents.push_back(std::move(document));
+    }
+    return corpus;
+}
+
+std::vector<std::string> GenerateQueries(const CorpusOptions& corpus_options, const QueryOptions& options) {
+    CheckCorpusOptions(corpus_options);
+    if (options.min_plus_words == 0 || options.min_plus_words > options.max_plus_words) {
+        throw std::invalid_argument("Invalid query length range"s);
+    }
+    std::mt19937_64 generator(options.seed);
+    const ZipfDistribution zipf(corpus_options.vocabulary_size, corpus_options.zipf_skew);
+    const auto get_word = [&] {
+        size_t rank = zipf(generator);
+        while (rank < corpus_options.stop_word_count) {
+            rank = zipf(generator);
+        }
+        return MakeWord(rank);
+    };
+
+    std::vector<std::string> queries(options.query_count);
+    for (std::string& query : queries) {
+        const size_t plus_word_count = GetUniform(generator, options.min_plus_words, options.max_plus_words);
+        for (size_t word = 0; word < plus_word_count; ++word) {
+            query += (word > 0 ? " "s : ""s) + get_word();
+        }
+        if (GetUniform(generator) < options.minus_word_probability) {
+            query += " -"s + get_word();
+        }
+    }
+    return queries;
+}
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkOptions& options) {
+    if (options.batch_size == 0) {
+        throw std::invalid_argument("Batch size must be positive"s);
+    }
+    const Corpus corpus = GenerateCorpus(options.corpus);
+    const std::vector<NewDocument> documents = corpus.GetNewDocuments();
+    const std::vector<std::string> queries = GenerateQueries(options.corpus, options.queries);
+
+    std::mt19937_64 generator(options.queries.seed + 1);
+    // Запрос i сопоставляется с документом match_ids[i].
+    std::vector<int> match_ids(documents.empty() ? 0 : queries.size());
+    for (int& document_id : match_ids) {
+        document_id = documents[GetUniform(generator, 0, documents.size() - 1)].id;
+    }
+    std::vector<int> remove_ids(documents.size());
+    std::transform(documents.begin(), documents.end(), remove_ids.begin(), [](const NewDocument& document) {
+        return document.id;
+    });
+    // std::shuffle в разных библиотеках переставляет по-разному.
+    for (size_t i = remove_ids.size(); i > 1; --i) {
+        std::swap(remove_ids[i - 1], remove_ids[GetUniform(generator, 0, i - 1)]);
+    }
+    remove_ids.resize(std::min(remove_ids.size(), options.remove_count));
+
+    std::vector<BenchmarkResult> results;
+    SearchServer search_server(corpus.stop_words);
+    results.push_back(Measure("AddDocument"s, documents.size(), [&](size_t i) {
+        search_server.AddDocument(documents[i].id, documents[i].text, documents[i].status, documents[i].ratings);
+        return std::pair(size_t{1}, size_t{0});
+    }));
+
+    results.push_back(MeasureFindTopDocuments("FindTopDocuments(seq)"s, std::execution::seq, search_server, queries));
+    results.push_back(MeasureFindTopDocuments("FindTopDocuments(par)"s, std::execution::par, search_server, queries));
+    results.push_back(MeasureMatchDocument("MatchDocument(seq)"s, std::execution::seq, search_server, queries, match_ids));
+    results.push_back(MeasureMatchDocument("MatchDocument(par)"s, std::execution::par, search_server, queries, match_ids));
+
+    const size_t query_batch_count = GetBatchCount(queries.size(), options.batch_size);
+    std::vector<std::string> query_batch;
+    const auto get_query_batch = [&](size_t batch) -> const std::vector<std::string>& {
+        const auto first = queries.begin() + batch * options.batch_size;
+        query_batch.assign(first, queries.begin() + std::min(queries.size(), (batch + 1) * options.batch_size));
+        return query_batch;
+    };
+    results.push_back(Measure("ProcessQueries"s, query_batch_count, [&](size_t batch) {
+        const std::vector<std::vector<Document>> found = ProcessQueries(search_server, get_query_batch(batch));
+        size_t result_count = 0;
+        for (const std::vector<Document>& documents : found) {
+            result_count += documents.size();
+        }
+        return std::pair(found.size(), result_count);
+    }));
+    results.push_back(Measure("ProcessQueriesJoined"s, query_batch_count, [&](size_t batch) {
+        const std::vector<std::string>& batch_queries = get_query_batch(batch);
+        return std::pair(batch_queries.size(), ProcessQueriesJoined(search_server, batch_queries).size());
+    }));
+
+    // Удаление меняет индекс, поэтому у каждой версии свой сервер, который
+    // заодно служит замеру пакетного добавления.
+    {
+        SearchServer removal_server(corpus.stop_words);
+        results.push_back(MeasureAddDocuments("AddDocuments(seq)"s, std::execution::seq, removal_server, documents, options.batch_size));
+        results.push_back(MeasureRemoveDocument("RemoveDocument(seq)"s, std::execution::seq, removal_server, remove_ids));
+    }
+    {
+        SearchServer removal_server(corpus.stop_words);
+        results.push_back(MeasureAddDocuments("AddDocuments(par)"s, std::execution::par, removal_server, documents, options.batch_size));
+        results.push_back(MeasureRemoveDocument("RemoveDocument(par)"s, std::execution::par, removal_server, remove_ids));
+    }
+    return results;
+}
+
+void PrintBenchmarkResults(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+    const CorpusOptions& corpus = options.corpus;
+    out << "# documents="s << corpus.document_count << " vocabulary="s << corpus.vocabulary_size
+        << " zipf="s << corpus.zipf_skew << " length="s << corpus.min_document_length << '-' << corpus.max_document_length
+        << " stop_words="s << corpus.stop_word_count << " statuses="s << corpus.status_weights[0] << ','
+        << corpus.status_weights[1] << ',' << corpus.status_weights[2] << ',' << corpus.status_weights[3]
+        << " seed="s << corpus.seed << '\n';
+    out << "# queries="s << options.queries.query_count << " plus_words="s << options.queries.min_plus_words << '-'
+        << options.queries.max_plus_words << " minus_probability="s << options.queries.minus_word_probability
+        << " query_seed="s << options.queries.seed << " batch="s << options.batch_size
+        << " removed="s << options.remove_count << '\n';
+    out << "# process_peak_rss_kb is the process maximum so far, not the peak of one benchmark\n"s;
+    out << "benchmark\titems\tresults\ttotal_ms\titems_per_s\tp50_us\tp99_us\tprocess_peak_rss_kb\n"s;
+    for (const BenchmarkResult& result : results) {
+        out << result.name << '\t' << result.item_count << '\t' << result.result_count << '\t'
+            << std::chrono::duration<double, std::milli>(result.total_time).count() << '\t'
+            << result.items_per_second << '\t'
+            << std::chrono::duration<double, std::micro>(result.latency_p50).count() << '\t'
+            << std::chrono::duration<double, std::micro>(result.latency_p99).count() << '\t'
+            << result.process_peak_rss_kb << '\n';
+    }
+}
+
+size_t GetPeakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    // На macOS ru_maxrss в байтах, в Linux — в килобайтах.
+    return static_cast<size_t>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#else
+    return 0;
+#endif
+}
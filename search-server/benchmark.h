@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Параметры синтетического корпуса. Слово ранга r выбирается с вероятностью,
+// пропорциональной 1 / r^zipf_skew, как в текстах на естественном языке.
+// Один и тот же seed на любой платформе даёт один и тот же корпус.
+struct CorpusOptions {
+    size_t document_count = 20000;
+    size_t vocabulary_size = 50000;
+    double zipf_skew = 1.0;
+    size_t min_document_length = 20;
+    size_t max_document_length = 200;
+    // Столько самых частых слов словаря объявляются стоп-словами.
+    size_t stop_word_count = 20;
+    // Относительные доли статусов ACTUAL, IRRELEVANT, BANNED и REMOVED.
+    std::array<double, 4> status_weights{0.7, 0.1, 0.1, 0.1};
+    uint64_t seed = 42;
+};
+
+// Запросы строятся из того же словаря и с тем же распределением слов,
+// что и корпус, но стоп-слов в них нет.
+struct QueryOptions {
+    size_t query_count = 5000;
+    size_t min_plus_words = 1;
+    size_t max_plus_words = 4;
+    double minus_word_probability = 0.2;
+    uint64_t seed = 4242;
+};
+
+struct GeneratedDocument {
+    int id;
+    std::string text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
+struct Corpus {
+    std::string stop_words;
+    std::vector<GeneratedDocument> documents;
+
+    // Представления документов для AddDocuments; живут, пока жив корпус.
+    std::vector<NewDocument> GetNewDocuments() const;
+};
+
+Corpus GenerateCorpus(const CorpusOptions& options);
+
+std::vector<std::string> GenerateQueries(const CorpusOptions& corpus_options, const QueryOptions& options);
+
+struct BenchmarkOptions {
+    CorpusOptions corpus;
+    QueryOptions queries;
+    // Пакеты такого размера уходят в AddDocuments и ProcessQueries.
+    size_t batch_size = 500;
+    size_t remove_count = 2000;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    // Обработанные документы или запросы.
+    size_t item_count = 0;
+    // Найденные документы или совпавшие слова. У seq и par версий одного
+    // метода должно совпадать.
+    size_t result_count = 0;
+    std::chrono::nanoseconds total_time{0};
+    double items_per_second = 0.0;
+    // Перцентили времени одного вызова: для пакетных методов — пакета.
+    std::chrono::nanoseconds latency_p50{0};
+    std::chrono::nanoseconds latency_p99{0};
+    // Наибольший объём памяти процесса за всё время до конца замера,
+    // а не пик этого замера: сбросить ru_maxrss нельзя. Замеры идут
+    // от меньших индексов к большим, чтобы рост был заметен.
+    size_t process_peak_rss_kb = 0;
+};
+
+// Строит корпус и запросы по options и замеряет seq и par версии
+// AddDocument(s), FindTopDocuments, MatchDocument, ProcessQueries
+// и RemoveDocument.
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkOptions& options);
+
+// Печатает параметры прогона и таблицу результатов, разделённую табуляциями,
+// чтобы её было удобно сравнивать с базовой.
+void PrintBenchmarkResults(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results);
+
+// Наибольший объём памяти процесса с его запуска.
+size_t GetPeakRssKb();
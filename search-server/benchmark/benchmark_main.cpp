@@ -0,0 +1,119 @@
+// Точка входа замеров производительности. Лежит в своём каталоге, чтобы
+// сборка всех исходников search-server вместе с main.cpp не получала
+// второй main. Собирается из тех же исходников без main.cpp, например
+// из каталога search-server:
+//   g++ -std=c++17 -O2 -DNDEBUG $(ls *.cpp | grep -v -e main.cpp -e test_) benchmark/benchmark_main.cpp -ltbb -lpthread
+// Параметры задаются как --name=value, таблица результатов печатается в stdout.
+
+#include "../benchmark.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+namespace {
+
+void PrintUsage(std::ostream& out) {
+    const BenchmarkOptions defaults;
+    out << "Usage: benchmark [--name=value ...]\n"s
+        << "  --documents=N      documents in corpus ("s << defaults.corpus.document_count << ")\n"s
+        << "  --vocabulary=N     distinct words ("s << defaults.corpus.vocabulary_size << ")\n"s
+        << "  --zipf=S           Zipf skew of word frequencies ("s << defaults.corpus.zipf_skew << ")\n"s
+        << "  --min-length=N     min words per document ("s << defaults.corpus.min_document_length << ")\n"s
+        << "  --max-length=N     max words per document ("s << defaults.corpus.max_document_length << ")\n"s
+        << "  --stop-words=N     most frequent words used as stop words ("s << defaults.corpus.stop_word_count << ")\n"s
+        << "  --statuses=A,I,B,R weights of ACTUAL, IRRELEVANT, BANNED, REMOVED\n"s
+        << "  --seed=N           corpus seed ("s << defaults.corpus.seed << ")\n"s
+        << "  --queries=N        queries per workload ("s << defaults.queries.query_count << ")\n"s
+        << "  --min-plus=N       min plus words per query ("s << defaults.queries.min_plus_words << ")\n"s
+        << "  --max-plus=N       max plus words per query ("s << defaults.queries.max_plus_words << ")\n"s
+        << "  --minus=P          probability of a minus word ("s << defaults.queries.minus_word_probability << ")\n"s
+        << "  --query-seed=N     query seed ("s << defaults.queries.seed << ")\n"s
+        << "  --batch=N          batch size for AddDocuments and ProcessQueries ("s << defaults.batch_size << ")\n"s
+        << "  --remove=N         documents removed by RemoveDocument ("s << defaults.remove_count << ")\n"s;
+}
+
+template <typename T>
+T ParseValue(const std::string& name, const std::string& text) {
+    std::istringstream in(text);
+    T value{};
+    if (!(in >> value) || !in.eof()) {
+        throw std::invalid_argument("Invalid value of "s + name + ": "s + text);
+    }
+    return value;
+}
+
+void ParseOption(const std::string& argument, BenchmarkOptions& options) {
+    const size_t separator = argument.find('=');
+    if (argument.rfind("--"s, 0) != 0 || separator == std::string::npos) {
+        throw std::invalid_argument("Unknown argument: "s + argument);
+    }
+    const std::string name = argument.substr(2, separator - 2);
+    const std::string value = argument.substr(separator + 1);
+    CorpusOptions& corpus = options.corpus;
+    QueryOptions& queries = options.queries;
+    if (name == "documents"s) {
+        corpus.document_count = ParseValue<size_t>(name, value);
+    } else if (name == "vocabulary"s) {
+        corpus.vocabulary_size = ParseValue<size_t>(name, value);
+    } else if (name == "zipf"s) {
+        corpus.zipf_skew = ParseValue<double>(name, value);
+    } else if (name == "min-length"s) {
+        corpus.min_document_length = ParseValue<size_t>(name, value);
+    } else if (name == "max-length"s) {
+        corpus.max_document_length = ParseValue<size_t>(name, value);
+    } else if (name == "stop-words"s) {
+        corpus.stop_word_count = ParseValue<size_t>(name, value);
+    } else if (name == "statuses"s) {
+        std::istringstream in(value);
+        std::string weight;
+        for (double& status_weight : corpus.status_weights) {
+            if (!std::getline(in, weight, ',')) {
+                throw std::invalid_argument("Expected four status weights: "s + value);
+            }
+            status_weight = ParseValue<double>(name, weight);
+        }
+    } else if (name == "seed"s) {
+        corpus.seed = ParseValue<uint64_t>(name, value);
+    } else if (name == "queries"s) {
+        queries.query_count = ParseValue<size_t>(name, value);
+    } else if (name == "min-plus"s) {
+        queries.min_plus_words = ParseValue<size_t>(name, value);
+    } else if (name == "max-plus"s) {
+        queries.max_plus_words = ParseValue<size_t>(name, value);
+    } else if (name == "minus"s) {
+        queries.minus_word_probability = ParseValue<double>(name, value);
+    } else if (name == "query-seed"s) {
+        queries.seed = ParseValue<uint64_t>(name, value);
+    } else if (name == "batch"s) {
+        options.batch_size = ParseValue<size_t>(name, value);
+    } else if (name == "remove"s) {
+        options.remove_count = ParseValue<size_t>(name, value);
+    } else {
+        throw std::invalid_argument("Unknown option: "s + name);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (argv[i] == "--help"s) {
+                PrintUsage(std::cout);
+                return 0;
+            }
+            ParseOption(argv[i], options);
+        }
+        PrintBenchmarkResults(std::cout, options, RunBenchmarks(options));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        PrintUsage(std::cerr);
+        return 1;
+    }
+    return 0;
+}
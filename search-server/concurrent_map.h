@@ -1,52 +1,323 @@
+#pragma once
+
 #include <map>
 #include <string>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <execution>
+#include <type_traits>
+#include <cstdint>
 #include <cassert>
 
+#include "hash_utils.h"
+
 using namespace std::string_literals;
 
-template <typename Key, typename Value>
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Спин-блокировка для коротких критических секций (test-and-test-and-set).
+class SpinLock {
+public:
+    void lock() noexcept {
+        while (true) {
+            if (!locked_.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            while (locked_.load(std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    bool try_lock() noexcept {
+        return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() noexcept {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked_ = false;
+};
+
+// Хеш-таблица, поделенная на шарды. Каждый шард выровнен по кэш-линии,
+// чтобы соседние шарды не делили одну линию, и хранит элементы в плоской
+// таблице с открытой адресацией и линейным пробированием. Тип блокировки
+// шарда задаётся параметром: std::mutex, SpinLock или std::shared_mutex
+// (тогда операции чтения берут разделяемую блокировку). Арифметические
+// значения хранятся в std::atomic: FetchAdd меняет их атомарно под
+// разделяемой блокировкой, а operator[] отдаёт ссылку на сам атомик.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Lock = std::mutex>
 class ConcurrentMap {
+public:
+    using StoredValue = std::conditional_t<std::is_arithmetic_v<Value>, std::atomic<Value>, Value>;
+
 private:
-    struct Bucket {
-        std::mutex mutex;
-        std::map<Key, Value> map;
+    struct Slot {
+        Key key;
+        StoredValue value;
+        bool is_used = false;
+        bool is_erased = false;
     };
-public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
 
-    struct Access {
-        std::lock_guard<std::mutex> guard;
-        Value& ref_to_value;
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        mutable Lock lock;
+        std::vector<Slot> slots;
+        size_t size = 0;
+        size_t erased = 0;
+    };
+
+    template <typename L, typename = void>
+    struct IsSharedLock : std::false_type { };
 
-        Access(const Key& key, Bucket& bucket) : guard(bucket.mutex), ref_to_value(bucket.map[key]) { }
+    template <typename L>
+    struct IsSharedLock<L, std::void_t<decltype(std::declval<L&>().lock_shared())>> : std::true_type { };
+
+    using WriteGuard = std::unique_lock<Lock>;
+    using ReadGuard = std::conditional_t<IsSharedLock<Lock>::value, std::shared_lock<Lock>, std::unique_lock<Lock>>;
+
+public:
+    struct Access {
+        WriteGuard guard;
+        StoredValue& ref_to_value;
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : buckets_(bucket_count) { }
+    explicit ConcurrentMap(size_t shard_count) : shards_(std::max<size_t>(shard_count, 1)) { }
 
     Access operator[](const Key& key) {
-        Bucket& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-        return Access{key, bucket};
+        const uint64_t hash = HashKey(key);
+        Shard& shard = GetShard(hash);
+        WriteGuard guard(shard.lock);
+        StoredValue& value = FindOrInsert(shard, key, hash);
+        return Access{std::move(guard), value};
+    }
+
+    // Атомарно прибавляет delta к значению по ключу и возвращает прежнее.
+    // Существующий ключ меняется под разделяемой блокировкой шарда,
+    // поэтому вызовы для ключей одного шарда не ждут друг друга.
+    // Отсутствующий ключ вставляется под исключительной блокировкой.
+    Value FetchAdd(const Key& key, Value delta) {
+        static_assert(std::is_arithmetic_v<Value> && !std::is_same_v<Value, bool>, "FetchAdd requires an arithmetic value type");
+        const uint64_t hash = HashKey(key);
+        Shard& shard = GetShard(hash);
+        {
+            ReadGuard guard(shard.lock);
+            if (const Slot* slot = FindSlot(shard, key, hash)) {
+                return AtomicAdd(const_cast<Slot*>(slot)->value, delta);
+            }
+        }
+        WriteGuard guard(shard.lock);
+        return AtomicAdd(FindOrInsert(shard, key, hash), delta);
+    }
+
+    std::optional<Value> Find(const Key& key) const {
+        const uint64_t hash = HashKey(key);
+        const Shard& shard = GetShard(hash);
+        ReadGuard guard(shard.lock);
+        const Slot* slot = FindSlot(shard, key, hash);
+        if (!slot) {
+            return std::nullopt;
+        }
+        return Load(slot->value);
     }
 
     std::size_t erase(const Key& key) {
-        Bucket& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-        std::lock_guard g(bucket.mutex);
-        return bucket.map.erase(key);
+        const uint64_t hash = HashKey(key);
+        Shard& shard = GetShard(hash);
+        WriteGuard guard(shard.lock);
+        Slot* slot = const_cast<Slot*>(FindSlot(shard, key, hash));
+        if (!slot) {
+            return 0;
+        }
+        slot->is_erased = true;
+        Store(slot->value, Value());
+        --shard.size;
+        ++shard.erased;
+        return 1;
     }
 
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
+    size_t size() const {
+        size_t result = 0;
+        for (const Shard& shard : shards_) {
+            ReadGuard guard(shard.lock);
+            result += shard.size;
+        }
+        return result;
+    }
+
+    // Вызывает func(key, value) для каждого элемента. Шарды обходятся
+    // согласно policy, каждый — под своей блокировкой.
+    template <typename ExecutionPolicy, typename Function>
+    void ForEach(ExecutionPolicy&& policy, Function func) {
+        std::for_each(policy, shards_.begin(), shards_.end(),
+            [&func](Shard& shard) {
+                WriteGuard guard(shard.lock);
+                for (Slot& slot : shard.slots) {
+                    if (slot.is_used && !slot.is_erased) {
+                        func(static_cast<const Key&>(slot.key), slot.value);
+                    }
+                }
+            });
+    }
+
+    template <typename Function>
+    void ForEach(Function func) {
+        ForEach(std::execution::seq, func);
+    }
+
+    // Сворачивает элементы без копирования: transform(key, value) даёт
+    // значение для каждого элемента, reduce объединяет их с init.
+    // Шарды сворачиваются согласно policy, частичные результаты — по порядку.
+    template <typename ExecutionPolicy, typename T, typename Reduce, typename Transform>
+    T TransformReduce(ExecutionPolicy&& policy, T init, Reduce reduce, Transform transform) const {
+        std::vector<std::optional<T>> partial_results(shards_.size());
+        std::transform(policy, shards_.begin(), shards_.end(), partial_results.begin(),
+            [&reduce, &transform](const Shard& shard) {
+                ReadGuard guard(shard.lock);
+                std::optional<T> result;
+                for (const Slot& slot : shard.slots) {
+                    if (slot.is_used && !slot.is_erased) {
+                        if (result) {
+                            result = reduce(std::move(*result), transform(slot.key, Load(slot.value)));
+                        } else {
+                            result = transform(slot.key, Load(slot.value));
+                        }
+                    }
+                }
+                return result;
+            });
 
-        for (auto& [mutex, map] : buckets_) {
-            std::lock_guard g(mutex);
-            result.insert(map.begin(), map.end());
+        for (std::optional<T>& partial_result : partial_results) {
+            if (partial_result) {
+                init = reduce(std::move(init), std::move(*partial_result));
+            }
         }
+        return init;
+    }
+
+    template <typename T, typename Reduce, typename Transform>
+    T TransformReduce(T init, Reduce reduce, Transform transform) const {
+        return TransformReduce(std::execution::seq, init, reduce, transform);
+    }
 
+    std::map<Key, Value> BuildOrdinaryMap() {
+        std::map<Key, Value> result;
+        ForEach([&result](const Key& key, const StoredValue& value) {
+            result.emplace(key, Load(value));
+        });
         return result;
     }
 
 private:
-    std::vector<Bucket> buckets_;
-};
\ No newline at end of file
+    std::vector<Shard> shards_;
+
+    // Младшие биты хеша выбирают ячейку, старшие — шард.
+    static uint64_t HashKey(const Key& key) {
+        return Mix(static_cast<uint64_t>(Hash{}(key)));
+    }
+
+    Shard& GetShard(uint64_t hash) {
+        return shards_[(hash >> 32) % shards_.size()];
+    }
+
+    const Shard& GetShard(uint64_t hash) const {
+        return shards_[(hash >> 32) % shards_.size()];
+    }
+
+    static const Slot* FindSlot(const Shard& shard, const Key& key, uint64_t hash) {
+        if (shard.slots.empty()) {
+            return nullptr;
+        }
+        const size_t mask = shard.slots.size() - 1;
+        for (size_t index = hash & mask;; index = (index + 1) & mask) {
+            const Slot& slot = shard.slots[index];
+            if (!slot.is_used) {
+                return nullptr;
+            }
+            if (!slot.is_erased && slot.key == key) {
+                return &slot;
+            }
+        }
+    }
+
+    // Число читается из атомика, остальные значения — по ссылке без копирования.
+    static decltype(auto) Load(const StoredValue& value) {
+        if constexpr (std::is_arithmetic_v<Value>) {
+            return value.load();
+        } else {
+            return (value);
+        }
+    }
+
+    template <typename T>
+    static void Store(StoredValue& value, T&& new_value) {
+        if constexpr (std::is_arithmetic_v<Value>) {
+            value.store(new_value);
+        } else {
+            value = std::forward<T>(new_value);
+        }
+    }
+
+    // У std::atomic для чисел с плавающей точкой в C++17 нет fetch_add.
+    static Value AtomicAdd(std::atomic<Value>& value, Value delta) {
+        if constexpr (std::is_integral_v<Value>) {
+            return value.fetch_add(delta);
+        } else {
+            Value previous = value.load(std::memory_order_relaxed);
+            while (!value.compare_exchange_weak(previous, previous + delta)) {
+            }
+            return previous;
+        }
+    }
+
+    static StoredValue& FindOrInsert(Shard& shard, const Key& key, uint64_t hash) {
+        if (Slot* slot = const_cast<Slot*>(FindSlot(shard, key, hash))) {
+            return slot->value;
+        }
+        if ((shard.size + shard.erased + 1) * 4 > shard.slots.size() * 3) {
+            Rehash(shard);
+        }
+        Slot& slot = ProbeFree(shard, hash);
+        if (slot.is_used) {
+            --shard.erased;
+        }
+        slot.key = key;
+        Store(slot.value, Value());
+        slot.is_used = true;
+        slot.is_erased = false;
+        ++shard.size;
+        return slot.value;
+    }
+
+    static Slot& ProbeFree(Shard& shard, uint64_t hash) {
+        const size_t mask = shard.slots.size() - 1;
+        size_t index = hash & mask;
+        while (shard.slots[index].is_used && !shard.slots[index].is_erased) {
+            index = (index + 1) & mask;
+        }
+        return shard.slots[index];
+    }
+
+    static void Rehash(Shard& shard) {
+        size_t capacity = 8;
+        while (capacity * 3 < (shard.size + 1) * 8) {
+            capacity *= 2;
+        }
+        std::vector<Slot> old_slots(capacity);
+        old_slots.swap(shard.slots);
+        shard.erased = 0;
+        for (Slot& slot : old_slots) {
+            if (slot.is_used && !slot.is_erased) {
+                Slot& new_slot = ProbeFree(shard, HashKey(slot.key));
+                new_slot.key = std::move(slot.key);
+                Store(new_slot.value, std::move(slot.value));
+                new_slot.is_used = true;
+            }
+        }
+    }
+};
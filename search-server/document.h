@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <iostream>
 #include <string>
 
@@ -22,6 +23,8 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+inline constexpr size_t DOCUMENT_STATUS_COUNT = 4;
+
 void PrintDocument(const Document& document);
 
 std::ostream& operator<<(std::ostream& out, DocumentStatus status);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Финализатор MurmurHash3: перемешивает биты так, что каждый бит входа
+// влияет на все биты результата. Годится и для целых ключей, у которых
+// std::hash — тождественная функция.
+inline uint64_t Mix(uint64_t value) noexcept {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
@@ -0,0 +1,105 @@
+#include "index_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : path_(path)
+    , output_(path, std::ios::binary | std::ios::trunc)
+{
+    if (!output_) {
+        throw std::runtime_error("Cannot open file "s + path);
+    }
+}
+
+void SnapshotWriter::Align() {
+    static constexpr char PADDING[8] = {};
+    WriteBytes(PADDING, (8 - position_ % 8) % 8);
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    output_.write(static_cast<const char*>(data), size);
+    position_ += size;
+}
+
+SnapshotStringTable SnapshotWriter::WriteStringTable(const std::vector<std::string_view>& strings) {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    uint64_t chars_size = 0;
+    for (const std::string_view str : strings) {
+        offsets.push_back(chars_size);
+        chars_size += str.size();
+    }
+    offsets.push_back(chars_size);
+
+    SnapshotStringTable table{strings.size(), WriteArray(offsets.data(), offsets.size()), 0, chars_size};
+    table.chars_offset = position_;
+    for (const std::string_view str : strings) {
+        WriteBytes(str.data(), str.size());
+    }
+    return table;
+}
+
+void SnapshotWriter::WriteAt(uint64_t position, const void* data, size_t size) {
+    output_.seekp(position);
+    output_.write(static_cast<const char*>(data), size);
+    output_.seekp(position_);
+}
+
+void SnapshotWriter::Close() {
+    output_.close();
+    if (!output_) {
+        throw std::runtime_error("Cannot write file "s + path_);
+    }
+}
+
+SnapshotReader::SnapshotReader(const MappedFile& file)
+    : file_(file)
+{
+    if (file_.size() < sizeof(SnapshotHeader)) {
+        throw std::invalid_argument("Index snapshot is truncated"s);
+    }
+    header_ = reinterpret_cast<const SnapshotHeader*>(file_.data());
+    if (std::memcmp(header_->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::invalid_argument("File is not an index snapshot"s);
+    }
+    if (header_->version != SNAPSHOT_VERSION) {
+        throw std::invalid_argument("Unsupported index snapshot version "s + std::to_string(header_->version));
+    }
+    if (header_->byte_order_mark != SNAPSHOT_BYTE_ORDER_MARK
+        || header_->block_record_size != sizeof(PostingList::Block)
+        || header_->max_postings_per_block != PostingList::BLOCK_SIZE) {
+        throw std::invalid_argument("Index snapshot was written on an incompatible platform"s);
+    }
+    if (header_->file_size != file_.size()) {
+        throw std::invalid_argument("Index snapshot is truncated"s);
+    }
+}
+
+std::vector<std::string_view> SnapshotReader::ReadStringTable(const SnapshotStringTable& table) const {
+    if (table.count == UINT64_MAX) {
+        throw std::invalid_argument("Index snapshot is corrupted"s);
+    }
+    const ArrayView<uint64_t> offsets = ReadArray<uint64_t>(table.offsets_offset, table.count + 1);
+    const ArrayView<char> chars = ReadArray<char>(table.chars_offset, table.chars_size);
+
+    std::vector<std::string_view> strings;
+    strings.reserve(table.count);
+    for (uint64_t i = 0; i < table.count; ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > chars.size()) {
+            throw std::invalid_argument("Index snapshot is corrupted"s);
+        }
+        strings.emplace_back(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+void SnapshotReader::CheckSection(uint64_t offset, uint64_t count, size_t record_size) const {
+    const uint64_t size = file_.size();
+    if (offset > size || count > (size - offset) / record_size || offset % std::min<size_t>(record_size, 8) != 0) {
+        throw std::invalid_argument("Index snapshot is corrupted"s);
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "posting_list.h"
+
+// Формат двоичного снимка индекса. Файл состоит из заголовка и секций
+// с массивами записей фиксированного размера, каждая секция выровнена
+// по 8 байт. Блоки и байты постинг-листов лежат в файле в том же виде,
+// что и в памяти, поэтому после mmap их можно читать без разбора.
+// Числа записываются в порядке байт машины, который проверяется при чтении.
+
+inline constexpr char SNAPSHOT_MAGIC[8] = {'S', 'S', 'I', 'N', 'D', 'E', 'X', '\0'};
+inline constexpr uint32_t SNAPSHOT_VERSION = 3;
+inline constexpr uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+// Строки таблицы идут подряд без разделителей, offsets_offset указывает
+// на массив из count + 1 смещений их начал внутри chars.
+struct SnapshotStringTable {
+    uint64_t count;
+    uint64_t offsets_offset;
+    uint64_t chars_offset;
+    uint64_t chars_size;
+};
+
+// Блоки постинг-листа — отрезок общего массива блоков, его байты —
+// отрезок общей секции данных. Смещения в блоках отсчитываются от data_offset.
+// Записи идут по словам, а у слова — по статусам документов в порядке
+// DocumentStatus.
+struct SnapshotPostingList {
+    uint64_t first_block;
+    uint64_t block_count;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t size;
+    double max_term_freq;
+};
+
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    uint32_t status;
+    uint32_t word_count;
+    uint64_t first_term;
+    uint64_t term_count;
+    // Номер документа в постинг-листах.
+    uint64_t internal_id;
+};
+
+struct SnapshotTermCount {
+    uint32_t term_id;
+    uint32_t count;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t block_record_size;
+    uint32_t max_postings_per_block;
+    uint64_t file_size;
+    SnapshotStringTable stop_words;
+    SnapshotStringTable terms;
+    uint64_t postings_offset;
+    uint64_t blocks_offset;
+    uint64_t block_count;
+    uint64_t posting_data_offset;
+    uint64_t posting_data_size;
+    uint64_t documents_offset;
+    uint64_t document_count;
+    uint64_t term_counts_offset;
+    uint64_t term_count_count;
+    // Число внутренних номеров документов, включая номера удалённых.
+    uint64_t document_slot_count;
+};
+
+// Последовательная запись секций снимка. Ошибки ввода-вывода
+// выбрасываются как std::runtime_error.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    uint64_t GetPosition() const noexcept {
+        return position_;
+    }
+
+    // Дополняет файл нулями до границы 8 байт.
+    void Align();
+
+    void WriteBytes(const void* data, size_t size);
+
+    // Записывает массив с выровненной позиции и возвращает её.
+    template <typename T>
+    uint64_t WriteArray(const T* values, size_t count) {
+        Align();
+        const uint64_t offset = position_;
+        WriteBytes(values, count * sizeof(T));
+        return offset;
+    }
+
+    SnapshotStringTable WriteStringTable(const std::vector<std::string_view>& strings);
+
+    void WriteAt(uint64_t position, const void* data, size_t size);
+
+    void Close();
+
+private:
+    std::string path_;
+    std::ofstream output_;
+    uint64_t position_ = 0;
+};
+
+// Доступ к секциям отображённого снимка с проверкой границ. Повреждённый
+// файл приводит к std::invalid_argument.
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const MappedFile& file);
+
+    const SnapshotHeader& GetHeader() const noexcept {
+        return *header_;
+    }
+
+    template <typename T>
+    ArrayView<T> ReadArray(uint64_t offset, uint64_t count) const {
+        CheckSection(offset, count, sizeof(T));
+        return ArrayView<T>(reinterpret_cast<const T*>(file_.data() + offset), count);
+    }
+
+    std::vector<std::string_view> ReadStringTable(const SnapshotStringTable& table) const;
+
+private:
+    const MappedFile& file_;
+    const SnapshotHeader* header_ = nullptr;
+
+    void CheckSection(uint64_t offset, uint64_t count, size_t record_size) const;
+};
@@ -0,0 +1,59 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SEARCH_SERVER_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef SEARCH_SERVER_HAS_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read size of file "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* address = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map file "s + path);
+        }
+        data_ = static_cast<const uint8_t*>(address);
+        is_mapped_ = true;
+    }
+    close(fd);
+#else
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input) {
+        throw std::runtime_error("Cannot open file "s + path);
+    }
+    size_ = static_cast<size_t>(input.tellg());
+    buffer_.resize((size_ + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    input.seekg(0);
+    if (!input.read(reinterpret_cast<char*>(buffer_.data()), size_)) {
+        throw std::runtime_error("Cannot read file "s + path);
+    }
+    data_ = reinterpret_cast<const uint8_t*>(buffer_.data());
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef SEARCH_SERVER_HAS_MMAP
+    if (is_mapped_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+}
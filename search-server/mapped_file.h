@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Файл, отображённый в память только для чтения. Страницы файла берутся
+// из общего кэша ОС, поэтому несколько процессов, открывших один файл,
+// делят одну его копию. Там, где mmap недоступен, файл читается целиком.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const noexcept {
+        return data_;
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool is_mapped_ = false;
+    // Запасной буфер, выровненный по 8 байт, как и отображение.
+    std::vector<uint64_t> buffer_;
+};
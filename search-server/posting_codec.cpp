@@ -0,0 +1,131 @@
+#include "posting_codec.h"
+
+#include <array>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_SSSE3_DECODER
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct DecodeTables {
+    std::array<uint8_t, 256> lengths;
+    alignas(16) uint8_t shuffles[256][16];
+};
+
+DecodeTables BuildDecodeTables() {
+    DecodeTables tables{};
+    for (int control = 0; control < 256; ++control) {
+        uint8_t offset = 0;
+        for (int i = 0; i < 4; ++i) {
+            const uint8_t length = ((control >> (2 * i)) & 3) + 1;
+            for (int j = 0; j < 4; ++j) {
+                tables.shuffles[control][4 * i + j] = j < length ? offset + j : 0x80;
+            }
+            offset += length;
+        }
+        tables.lengths[control] = offset;
+    }
+    return tables;
+}
+
+const DecodeTables& GetDecodeTables() {
+    static const DecodeTables tables = BuildDecodeTables();
+    return tables;
+}
+
+uint8_t GetByteLength(uint32_t value) {
+    if (value < (1u << 8)) {
+        return 1;
+    }
+    if (value < (1u << 16)) {
+        return 2;
+    }
+    if (value < (1u << 24)) {
+        return 3;
+    }
+    return 4;
+}
+
+const uint8_t* DecodeQuadScalar(uint8_t control, const uint8_t* data, uint32_t* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t length = ((control >> (2 * i)) & 3) + 1;
+        uint32_t value = 0;
+        for (uint8_t j = 0; j < length; ++j) {
+            value |= static_cast<uint32_t>(data[j]) << (8 * j);
+        }
+        out[i] = value;
+        data += length;
+    }
+    return data;
+}
+
+#ifdef SEARCH_SERVER_SSSE3_DECODER
+__attribute__((target("ssse3")))
+size_t DecodeQuadsSsse3(const uint8_t* control, const uint8_t*& data, const uint8_t* buffer_end, size_t quad_count, uint32_t* out) {
+    const DecodeTables& tables = GetDecodeTables();
+    size_t quad = 0;
+    for (; quad < quad_count && data + 16 <= buffer_end; ++quad) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.shuffles[control[quad]]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * quad), _mm_shuffle_epi8(bytes, shuffle));
+        data += tables.lengths[control[quad]];
+    }
+    return quad;
+}
+
+bool HasSsse3() {
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    return has_ssse3;
+}
+#endif
+
+}
+
+void EncodeStreamVByte(const uint32_t* values, size_t count, std::vector<uint8_t>& out) {
+    const size_t control_begin = out.size();
+    const size_t control_size = (count + 3) / 4;
+    out.resize(out.size() + control_size, 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t length = GetByteLength(values[i]);
+        out[control_begin + i / 4] |= static_cast<uint8_t>((length - 1) << (2 * (i % 4)));
+        for (uint8_t j = 0; j < length; ++j) {
+            out.push_back(static_cast<uint8_t>(values[i] >> (8 * j)));
+        }
+    }
+}
+
+const uint8_t* DecodeStreamVByte(const uint8_t* in, const uint8_t* buffer_end, size_t count, uint32_t* out) {
+    const uint8_t* control = in;
+    const size_t full_quad_count = count / 4;
+    const uint8_t* data = in + (count + 3) / 4;
+
+    size_t quad = 0;
+#ifdef SEARCH_SERVER_SSSE3_DECODER
+    if (HasSsse3()) {
+        quad = DecodeQuadsSsse3(control, data, buffer_end, full_quad_count, out);
+    }
+#endif
+    for (; quad < full_quad_count; ++quad) {
+        data = DecodeQuadScalar(control[quad], data, out + 4 * quad, 4);
+    }
+    if (count % 4 != 0) {
+        data = DecodeQuadScalar(control[full_quad_count], data, out + 4 * full_quad_count, count % 4);
+    }
+    return data;
+}
+
+size_t GetStreamVByteSize(const uint8_t* in, size_t count) {
+    const DecodeTables& tables = GetDecodeTables();
+    const size_t control_size = (count + 3) / 4;
+    size_t size = control_size;
+    for (size_t quad = 0; quad < count / 4; ++quad) {
+        size += tables.lengths[in[quad]];
+    }
+    for (size_t i = 0; i < count % 4; ++i) {
+        size += ((in[count / 4] >> (2 * i)) & 3) + 1;
+    }
+    return size;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Кодек StreamVByte для 32-битных целых. Значения кодируются группами
+// по четыре: управляющий байт хранит длину каждого значения (1–4 байта),
+// сами байты значений идут отдельным потоком. Управляющие байты всех групп
+// записываются перед данными, поэтому для декодирования нужно знать
+// только количество значений.
+//
+// Декодер на x86 с SSSE3 разворачивает целую группу одной инструкцией
+// pshufb, на остальных платформах используется скалярный вариант.
+
+void EncodeStreamVByte(const uint32_t* values, size_t count, std::vector<uint8_t>& out);
+
+// Декодирует count значений, начиная с in. buffer_end — конец доступного
+// для чтения буфера: векторный путь читает по 16 байт и не выходит за него.
+// Возвращает указатель на первый байт после закодированных данных.
+const uint8_t* DecodeStreamVByte(const uint8_t* in, const uint8_t* buffer_end, size_t count, uint32_t* out);
+
+// Размер в байтах закодированной последовательности из count значений,
+// начинающейся с in. Читает только управляющие байты.
+size_t GetStreamVByteSize(const uint8_t* in, size_t count);
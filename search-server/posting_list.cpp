@@ -0,0 +1,513 @@
+#include "posting_list.h"
+#include "posting_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+PostingList::PostingList(ArrayView<Block> blocks, ArrayView<uint8_t> data, size_t size, double max_term_freq)
+    : mapped_blocks_(blocks)
+    , mapped_data_(data)
+    , is_mapped_(true)
+    , size_(size)
+    , max_term_freq_(max_term_freq)
+{
+    // Каждый блок раскодируется один раз: курсоры и поиск доверяют
+    // постингам, так что id должны строго возрастать в границах заголовка,
+    // а длины документов — быть ненулевыми. По max_term_freq блоков и списка
+    // отсекаются документы при поиске, поэтому они не должны быть меньше
+    // настоящих.
+    size_t posting_count = 0;
+    double list_max_term_freq = 0.0;
+    size_t offset = 0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const Block& block = blocks[i];
+        if (block.size == 0 || block.size > BLOCK_SIZE || block.offset != offset
+            || block.first_document_id < 0 || block.first_document_id > block.last_document_id
+            || (i > 0 && blocks[i - 1].last_document_id >= block.first_document_id)) {
+            throw std::invalid_argument("Posting list blocks are inconsistent"s);
+        }
+        const size_t value_count = 3 * block.size - 1;
+        if ((value_count + 3) / 4 > data.size() - offset) {
+            throw std::invalid_argument("Posting list data is truncated"s);
+        }
+        const size_t block_size = GetStreamVByteSize(data.data() + offset, value_count);
+        if (block_size > data.size() - offset) {
+            throw std::invalid_argument("Posting list data is truncated"s);
+        }
+
+        uint32_t values[3 * BLOCK_SIZE];
+        DecodeStreamVByte(data.data() + offset, data.end(), value_count, values);
+        const uint32_t* term_counts = values + block.size - 1;
+        const uint32_t* document_lengths = term_counts + block.size;
+        int64_t document_id = block.first_document_id;
+        double block_max_term_freq = 0.0;
+        for (size_t j = 0; j < block.size; ++j) {
+            if (j > 0) {
+                document_id += values[j - 1];
+            }
+            if ((j > 0 && values[j - 1] == 0) || document_id > block.last_document_id
+                || term_counts[j] == 0 || document_lengths[j] == 0 || term_counts[j] > document_lengths[j]) {
+                throw std::invalid_argument("Posting list data is inconsistent"s);
+            }
+            block_max_term_freq = std::max(block_max_term_freq, ComputeTermFreq(term_counts[j], document_lengths[j]));
+        }
+        if (document_id != block.last_document_id || !(block_max_term_freq <= block.max_term_freq)) {
+            throw std::invalid_argument("Posting list data is inconsistent"s);
+        }
+        offset += block_size;
+        posting_count += block.size;
+        list_max_term_freq = std::max(list_max_term_freq, block_max_term_freq);
+    }
+    if (offset != data.size() || posting_count != size) {
+        throw std::invalid_argument("Posting list blocks are inconsistent"s);
+    }
+    if (!(list_max_term_freq <= max_term_freq)) {
+        throw std::invalid_argument("Posting list data is inconsistent"s);
+    }
+}
+
+void PostingList::Add(int document_id, uint32_t term_count, uint32_t document_length) {
+    Detach();
+    const Posting posting{document_id, term_count, document_length};
+
+    // Документы обычно добавляются по возрастанию id, поэтому в большинстве
+    // случаев постинг дописывается в последний блок или открывает новый.
+    if (blocks_.empty() || blocks_.back().last_document_id < document_id) {
+        if (!blocks_.empty() && blocks_.back().size < BLOCK_SIZE) {
+            std::vector<Posting> postings = DecodeRawBlock(blocks_.size() - 1);
+            postings.push_back(posting);
+            ReplaceBlock(blocks_.size() - 1, postings);
+        } else {
+            blocks_.push_back({document_id, document_id, static_cast<uint32_t>(data_.size()), 0, 0.0});
+            ReplaceBlock(blocks_.size() - 1, {posting});
+        }
+        ++size_;
+        max_term_freq_ = std::max(max_term_freq_, ComputeTermFreq(term_count, document_length));
+        return;
+    }
+
+    const size_t block_index = FindBlock(document_id);
+    std::vector<Posting> postings = DecodeRawBlock(block_index);
+    auto it = std::lower_bound(postings.begin(), postings.end(), document_id,
+        [](const Posting& existing, int id) {
+            return existing.document_id < id;
+        });
+    if (it != postings.end() && it->document_id == document_id) {
+        it->term_count += term_count;
+    } else {
+        postings.insert(it, posting);
+        ++size_;
+    }
+    ReplaceBlock(block_index, postings);
+    UpdateMaxTermFreq();
+}
+
+void PostingList::Add(const std::vector<Posting>& postings) {
+    if (postings.empty()) {
+        return;
+    }
+    Detach();
+    if (!blocks_.empty() && blocks_.back().last_document_id >= postings.front().document_id) {
+        for (const Posting& posting : postings) {
+            Add(posting.document_id, posting.term_count, posting.document_length);
+        }
+        return;
+    }
+
+    std::vector<Posting> tail;
+    size_t block_index = blocks_.size();
+    if (!blocks_.empty() && blocks_.back().size < BLOCK_SIZE) {
+        --block_index;
+        tail = DecodeRawBlock(block_index);
+    } else {
+        blocks_.push_back({postings.front().document_id, postings.front().document_id, static_cast<uint32_t>(data_.size()), 0, 0.0});
+    }
+    tail.insert(tail.end(), postings.begin(), postings.end());
+    ReplaceBlock(block_index, tail);
+
+    size_ += postings.size();
+    for (const Posting& posting : postings) {
+        max_term_freq_ = std::max(max_term_freq_, ComputeTermFreq(posting.term_count, posting.document_length));
+    }
+}
+
+bool PostingList::Erase(int document_id) {
+    const size_t block_index = FindBlock(document_id);
+    if (block_index == GetBlocks().size() || GetBlocks()[block_index].first_document_id > document_id) {
+        return false;
+    }
+
+    Detach();
+    std::vector<Posting> postings = DecodeRawBlock(block_index);
+    auto it = std::lower_bound(postings.begin(), postings.end(), document_id,
+        [](const Posting& existing, int id) {
+            return existing.document_id < id;
+        });
+    if (it == postings.end() || it->document_id != document_id) {
+        return false;
+    }
+    postings.erase(it);
+    --size_;
+    ReplaceBlock(block_index, postings);
+    UpdateMaxTermFreq();
+    return true;
+}
+
+size_t PostingList::Erase(const std::vector<int>& document_ids) {
+    std::vector<Posting> kept;
+    kept.reserve(size_);
+    auto id_it = document_ids.begin();
+    for (size_t block_index = 0; block_index < GetBlocks().size(); ++block_index) {
+        for (const Posting& posting : DecodeRawBlock(block_index)) {
+            id_it = std::lower_bound(id_it, document_ids.end(), posting.document_id);
+            if (id_it == document_ids.end() || *id_it != posting.document_id) {
+                kept.push_back(posting);
+            }
+        }
+    }
+    const size_t erased_count = size_ - kept.size();
+    if (erased_count == 0) {
+        return 0;
+    }
+    Rebuild(kept);
+    return erased_count;
+}
+
+void PostingList::RenumberDocuments(const std::vector<int>& new_ids) {
+    std::vector<Posting> postings;
+    postings.reserve(size_);
+    for (size_t block_index = 0; block_index < GetBlocks().size(); ++block_index) {
+        for (Posting posting : DecodeRawBlock(block_index)) {
+            posting.document_id = new_ids[posting.document_id];
+            postings.push_back(posting);
+        }
+    }
+    Rebuild(postings);
+}
+
+void PostingList::ShrinkToFit() {
+    blocks_.shrink_to_fit();
+    data_.shrink_to_fit();
+}
+
+bool PostingList::Contains(int document_id) const {
+    const ArrayView<Block> blocks = GetBlocks();
+    const size_t block_index = FindBlock(document_id);
+    if (block_index == blocks.size() || blocks[block_index].first_document_id > document_id) {
+        return false;
+    }
+
+    DecodedBlock decoded;
+    DecodeBlock(block_index, decoded);
+    return std::binary_search(decoded.document_ids, decoded.document_ids + decoded.size, document_id);
+}
+
+void PostingList::DecodeBlock(size_t block_index, DecodedBlock& decoded) const {
+    const Block& block = GetBlocks()[block_index];
+    const ArrayView<uint8_t> data = GetData();
+    uint32_t values[3 * BLOCK_SIZE];
+    DecodeStreamVByte(data.data() + block.offset, data.end(), 3 * block.size - 1, values);
+
+    const uint32_t* deltas = values;
+    const uint32_t* term_counts = values + block.size - 1;
+    const uint32_t* document_lengths = term_counts + block.size;
+
+    decoded.size = block.size;
+    int document_id = block.first_document_id;
+    for (size_t i = 0; i < block.size; ++i) {
+        if (i > 0) {
+            document_id += static_cast<int>(deltas[i - 1]);
+        }
+        decoded.document_ids[i] = document_id;
+        decoded.term_freqs[i] = ComputeTermFreq(term_counts[i], document_lengths[i]);
+    }
+}
+
+void PostingList::Rebuild(const std::vector<Posting>& postings) {
+    mapped_blocks_ = {};
+    mapped_data_ = {};
+    is_mapped_ = false;
+    blocks_.clear();
+    data_.clear();
+    size_ = 0;
+    max_term_freq_ = 0.0;
+    Add(postings);
+}
+
+void PostingList::Detach() {
+    if (!is_mapped_) {
+        return;
+    }
+    blocks_.assign(mapped_blocks_.begin(), mapped_blocks_.end());
+    data_.assign(mapped_data_.begin(), mapped_data_.end());
+    mapped_blocks_ = {};
+    mapped_data_ = {};
+    is_mapped_ = false;
+}
+
+size_t PostingList::FindBlock(int document_id) const {
+    const ArrayView<Block> blocks = GetBlocks();
+    return std::lower_bound(blocks.begin(), blocks.end(), document_id,
+        [](const Block& block, int id) {
+            return block.last_document_id < id;
+        }) - blocks.begin();
+}
+
+std::vector<PostingList::Posting> PostingList::DecodeRawBlock(size_t block_index) const {
+    const Block& block = GetBlocks()[block_index];
+    const ArrayView<uint8_t> data = GetData();
+    uint32_t values[3 * BLOCK_SIZE];
+    DecodeStreamVByte(data.data() + block.offset, data.end(), 3 * block.size - 1, values);
+
+    std::vector<Posting> postings(block.size);
+    int document_id = block.first_document_id;
+    for (size_t i = 0; i < block.size; ++i) {
+        if (i > 0) {
+            document_id += static_cast<int>(values[i - 1]);
+        }
+        postings[i] = {document_id, values[block.size - 1 + i], values[2 * block.size - 1 + i]};
+    }
+    return postings;
+}
+
+// Перекодирует блок block_index из postings. Пустой список удаляет блок,
+// а переполненный делится на несколько блоков.
+void PostingList::ReplaceBlock(size_t block_index, const std::vector<Posting>& postings) {
+    const size_t old_begin = blocks_[block_index].offset;
+    const size_t old_end = block_index + 1 < blocks_.size() ? blocks_[block_index + 1].offset : data_.size();
+
+    std::vector<Block> new_blocks;
+    std::vector<uint8_t> encoded;
+    for (size_t begin = 0; begin < postings.size(); begin += BLOCK_SIZE) {
+        const size_t end = std::min(begin + BLOCK_SIZE, postings.size());
+        const size_t size = end - begin;
+        Block block{postings[begin].document_id, postings[end - 1].document_id,
+                    static_cast<uint32_t>(old_begin + encoded.size()), static_cast<uint32_t>(size), 0.0};
+
+        uint32_t values[3 * BLOCK_SIZE];
+        for (size_t i = 0; i < size; ++i) {
+            const Posting& posting = postings[begin + i];
+            if (i > 0) {
+                values[i - 1] = static_cast<uint32_t>(posting.document_id - postings[begin + i - 1].document_id);
+            }
+            values[size - 1 + i] = posting.term_count;
+            values[2 * size - 1 + i] = posting.document_length;
+            block.max_term_freq = std::max(block.max_term_freq, ComputeTermFreq(posting.term_count, posting.document_length));
+        }
+        EncodeStreamVByte(values, 3 * size - 1, encoded);
+        new_blocks.push_back(block);
+    }
+
+    if (old_end == data_.size()) {
+        data_.resize(old_begin);
+        data_.insert(data_.end(), encoded.begin(), encoded.end());
+    } else {
+        data_.erase(data_.begin() + old_begin, data_.begin() + old_end);
+        data_.insert(data_.begin() + old_begin, encoded.begin(), encoded.end());
+    }
+
+    const auto shift = static_cast<int64_t>(encoded.size()) - static_cast<int64_t>(old_end - old_begin);
+    for (size_t i = block_index + 1; i < blocks_.size(); ++i) {
+        blocks_[i].offset = static_cast<uint32_t>(blocks_[i].offset + shift);
+    }
+
+    blocks_.erase(blocks_.begin() + block_index);
+    blocks_.insert(blocks_.begin() + block_index, new_blocks.begin(), new_blocks.end());
+}
+
+void PostingList::UpdateMaxTermFreq() {
+    max_term_freq_ = 0.0;
+    for (const Block& block : blocks_) {
+        max_term_freq_ = std::max(max_term_freq_, block.max_term_freq);
+    }
+}
+
+TermPostings::TermPostings(const TermPostings& other)
+    : actual_(other.actual_)
+    , other_statuses_(other.other_statuses_)
+{ }
+
+TermPostings::TermPostings(TermPostings&& other) noexcept
+    : actual_(std::move(other.actual_))
+    , other_statuses_(std::move(other.other_statuses_))
+{ }
+
+TermPostings& TermPostings::operator=(const TermPostings& other) {
+    if (this != &other) {
+        *this = TermPostings(other);
+    }
+    return *this;
+}
+
+// Кэш IDF — производные данные, поэтому после присваивания он сбрасывается.
+TermPostings& TermPostings::operator=(TermPostings&& other) noexcept {
+    actual_ = std::move(other.actual_);
+    other_statuses_ = std::move(other.other_statuses_);
+    idf_index_version_.store(NO_INDEX_VERSION, std::memory_order_relaxed);
+    return *this;
+}
+
+PostingList& TermPostings::Get(DocumentStatus status) {
+    if (status == DocumentStatus::ACTUAL) {
+        return actual_;
+    }
+    if (other_statuses_.empty()) {
+        other_statuses_.resize(DOCUMENT_STATUS_COUNT - 1);
+    }
+    return other_statuses_[static_cast<size_t>(status) - 1];
+}
+
+void TermPostings::RenumberDocuments(const std::vector<int>& new_ids) {
+    if (!actual_.empty()) {
+        actual_.RenumberDocuments(new_ids);
+    }
+    for (PostingList& postings : other_statuses_) {
+        if (!postings.empty()) {
+            postings.RenumberDocuments(new_ids);
+        }
+    }
+}
+
+const PostingList* TermPostings::Find(DocumentStatus status) const noexcept {
+    const PostingList* postings = &actual_;
+    if (status != DocumentStatus::ACTUAL) {
+        if (other_statuses_.empty()) {
+            return nullptr;
+        }
+        postings = &other_statuses_[static_cast<size_t>(status) - 1];
+    }
+    return postings->empty() ? nullptr : postings;
+}
+
+bool TermPostings::Contains(DocumentStatus status, int document_id) const {
+    const PostingList* postings = Find(status);
+    return postings && postings->Contains(document_id);
+}
+
+double TermPostings::GetInverseDocumentFreq(uint64_t index_version, int document_count) const {
+    if (idf_index_version_.load(std::memory_order_acquire) != index_version) {
+        // Одновременно пересчитать IDF могут несколько потоков, но значение
+        // у всех получится одно и то же.
+        inverse_document_freq_.store(std::log(document_count * 1.0 / size()), std::memory_order_relaxed);
+        idf_index_version_.store(index_version, std::memory_order_release);
+    }
+    return inverse_document_freq_.load(std::memory_order_relaxed);
+}
+
+size_t TermPostings::GetMemoryUsage() const noexcept {
+    size_t memory_usage = sizeof(*this) - sizeof(PostingList) + actual_.GetMemoryUsage()
+                        + (other_statuses_.capacity() - other_statuses_.size()) * sizeof(PostingList);
+    for (const PostingList& postings : other_statuses_) {
+        memory_usage += postings.GetMemoryUsage();
+    }
+    return memory_usage;
+}
+
+size_t TermPostings::GetUnusedCapacity() const noexcept {
+    size_t unused_capacity = actual_.GetUnusedCapacity();
+    for (const PostingList& postings : other_statuses_) {
+        unused_capacity += postings.GetUnusedCapacity();
+    }
+    return unused_capacity;
+}
+
+void TermPostings::ShrinkToFit() {
+    actual_.ShrinkToFit();
+    if (std::all_of(other_statuses_.begin(), other_statuses_.end(), [](const PostingList& postings) { return postings.empty(); })) {
+        other_statuses_ = {};
+    }
+    for (PostingList& postings : other_statuses_) {
+        postings.ShrinkToFit();
+    }
+}
+
+size_t TermPostings::size() const noexcept {
+    size_t size = actual_.size();
+    for (const PostingList& postings : other_statuses_) {
+        size += postings.size();
+    }
+    return size;
+}
+
+PostingCursor::PostingCursor(const PostingList& list)
+    : PostingCursor(list, 0.0, std::numeric_limits<int>::min(), std::numeric_limits<int>::max())
+{ }
+
+PostingCursor::PostingCursor(const PostingList& list, double inverse_document_freq, int first_document_id, int last_document_id)
+    : list_(&list)
+    , inverse_document_freq_(inverse_document_freq)
+    , last_document_id_(last_document_id)
+{
+    const ArrayView<PostingList::Block> blocks = list.GetBlocks();
+    const size_t block_index = std::lower_bound(blocks.begin(), blocks.end(), first_document_id,
+        [](const PostingList::Block& block, int id) {
+            return block.last_document_id < id;
+        }) - blocks.begin();
+    LoadBlock(block_index);
+    NextGeq(first_document_id);
+    CheckEnd();
+}
+
+void PostingCursor::Next() {
+    ++position_;
+    if (position_ == decoded_.size) {
+        LoadBlock(block_ + 1);
+    }
+    CheckEnd();
+}
+
+void PostingCursor::NextGeq(int document_id) {
+    if (is_end_ || GetDocumentId() >= document_id) {
+        return;
+    }
+
+    const ArrayView<PostingList::Block> blocks = list_->GetBlocks();
+    if (blocks[block_].last_document_id < document_id) {
+        const size_t block_index = std::lower_bound(blocks.begin() + block_ + 1, blocks.end(), document_id,
+            [](const PostingList::Block& block, int id) {
+                return block.last_document_id < id;
+            }) - blocks.begin();
+        LoadBlock(block_index);
+        if (is_end_) {
+            return;
+        }
+    }
+
+    position_ = std::lower_bound(decoded_.document_ids + position_, decoded_.document_ids + decoded_.size, document_id)
+                - decoded_.document_ids;
+    CheckEnd();
+}
+
+double PostingCursor::GetBlockMaxTermFreq(int document_id) {
+    if (document_id > last_document_id_) {
+        return 0.0;
+    }
+    const ArrayView<PostingList::Block> blocks = list_->GetBlocks();
+    shallow_block_ = std::max(shallow_block_, block_);
+    while (shallow_block_ < blocks.size() && blocks[shallow_block_].last_document_id < document_id) {
+        ++shallow_block_;
+    }
+    return shallow_block_ < blocks.size() ? blocks[shallow_block_].max_term_freq : 0.0;
+}
+
+void PostingCursor::LoadBlock(size_t block_index) {
+    block_ = block_index;
+    position_ = 0;
+    if (block_index >= list_->GetBlocks().size()) {
+        is_end_ = true;
+        decoded_.size = 0;
+        return;
+    }
+    list_->DecodeBlock(block_index, decoded_);
+}
+
+void PostingCursor::CheckEnd() {
+    if (!is_end_ && decoded_.document_ids[position_] > last_document_id_) {
+        is_end_ = true;
+    }
+}
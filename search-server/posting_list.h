@@ -0,0 +1,283 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "document.h"
+
+// Частота слова в документе: доля его вхождений среди всех слов документа.
+inline double ComputeTermFreq(uint32_t term_count, uint32_t document_length) {
+    return static_cast<double>(term_count) / document_length;
+}
+
+// Непрерывный массив, которым представление не владеет.
+template <typename T>
+class ArrayView {
+public:
+    ArrayView() = default;
+
+    ArrayView(const T* data, size_t size)
+        : data_(data)
+        , size_(size)
+    { }
+
+    ArrayView(const std::vector<T>& values)
+        : ArrayView(values.data(), values.size())
+    { }
+
+    const T* begin() const noexcept {
+        return data_;
+    }
+
+    const T* end() const noexcept {
+        return data_ + size_;
+    }
+
+    const T* data() const noexcept {
+        return data_;
+    }
+
+    const T& operator[](size_t index) const noexcept {
+        return data_[index];
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Постинг-лист одного слова в сжатом виде. Постинги (document_id, число
+// вхождений слова, длина документа) отсортированы по document_id и разбиты
+// на блоки не длиннее BLOCK_SIZE. Внутри блока document_id хранятся
+// разностями, и все числа блока кодируются StreamVByte в общий буфер.
+// Вместо term_freq хранятся исходные целые, из которых она точно
+// восстанавливается, — так частоты квантуются без потери точности.
+//
+// Для досрочного отсечения документов у каждого блока есть заголовок
+// с границами document_id и максимальной term_freq, так что блоки можно
+// пропускать, не раскодируя.
+//
+// Список, загруженный из снимка индекса, не копирует блоки и байты, а читает
+// их прямо из отображённого в память файла. Перед первым изменением они
+// копируются в собственные буферы.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    struct Block {
+        int first_document_id;
+        int last_document_id;
+        uint32_t offset;
+        uint32_t size;
+        double max_term_freq;
+    };
+
+    struct Posting {
+        int document_id;
+        uint32_t term_count;
+        uint32_t document_length;
+    };
+
+    struct DecodedBlock {
+        int document_ids[BLOCK_SIZE];
+        double term_freqs[BLOCK_SIZE];
+        size_t size = 0;
+    };
+
+    PostingList() = default;
+    // Список поверх чужой памяти, которая должна жить дольше него. Бросает
+    // std::invalid_argument, если блоки не согласованы между собой и с data.
+    PostingList(ArrayView<Block> blocks, ArrayView<uint8_t> data, size_t size, double max_term_freq);
+
+    void Add(int document_id, uint32_t term_count, uint32_t document_length);
+
+    // Добавляет постинги разных документов, упорядоченные по возрастанию
+    // document_id. Если все они новее уже имеющихся, список дописывается
+    // целыми блоками за один проход.
+    void Add(const std::vector<Posting>& postings);
+
+    bool Erase(int document_id);
+
+    // Удаляет постинги документов document_ids, упорядоченных по возрастанию,
+    // и перекодирует список за один проход. Возвращает число удалённых.
+    size_t Erase(const std::vector<int>& document_ids);
+
+    // Заменяет каждый document_id на new_ids[document_id] и перекодирует
+    // список. Отображение должно быть возрастающим на id из списка.
+    void RenumberDocuments(const std::vector<int>& new_ids);
+
+    bool Contains(int document_id) const;
+
+    void DecodeBlock(size_t block_index, DecodedBlock& decoded) const;
+
+    // Постинги блока с исходными term_count и document_length.
+    std::vector<Posting> DecodeRawBlock(size_t block_index) const;
+
+    double GetMaxTermFreq() const noexcept {
+        return max_term_freq_;
+    }
+
+    ArrayView<Block> GetBlocks() const noexcept {
+        return is_mapped_ ? mapped_blocks_ : ArrayView<Block>(blocks_);
+    }
+
+    ArrayView<uint8_t> GetData() const noexcept {
+        return is_mapped_ ? mapped_data_ : ArrayView<uint8_t>(data_);
+    }
+
+    // Отображённая память общая для всех копий и процессов и не учитывается.
+    size_t GetMemoryUsage() const noexcept {
+        return sizeof(*this) + blocks_.capacity() * sizeof(Block) + data_.capacity();
+    }
+
+    // Память, выделенная под блоки и данные сверх нужного.
+    size_t GetUnusedCapacity() const noexcept {
+        return (blocks_.capacity() - blocks_.size()) * sizeof(Block) + data_.capacity() - data_.size();
+    }
+
+    void ShrinkToFit();
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+private:
+    std::vector<Block> blocks_;
+    std::vector<uint8_t> data_;
+    ArrayView<Block> mapped_blocks_;
+    ArrayView<uint8_t> mapped_data_;
+    bool is_mapped_ = false;
+    size_t size_ = 0;
+    double max_term_freq_ = 0.0;
+
+    // Собирает список заново из упорядоченных постингов.
+    void Rebuild(const std::vector<Posting>& postings);
+
+    void Detach();
+
+    size_t FindBlock(int document_id) const;
+
+    void ReplaceBlock(size_t block_index, const std::vector<Posting>& postings);
+
+    void UpdateMaxTermFreq();
+};
+
+// Постинг-листы одного слова, разделённые по статусу документа. Документ
+// лежит ровно в одном из них, поэтому поиск по статусу читает только свой
+// список и не проверяет статус каждого постинга. Обычно почти все документы
+// актуальны, и списки остальных статусов заводятся только с появлением
+// в них первого документа. IDF слова зависит от всех списков сразу,
+// поэтому кэшируется здесь и пересчитывается лениво при первом запросе
+// после изменения индекса.
+class TermPostings {
+public:
+    TermPostings() = default;
+    TermPostings(const TermPostings& other);
+    TermPostings(TermPostings&& other) noexcept;
+    TermPostings& operator=(const TermPostings& other);
+    TermPostings& operator=(TermPostings&& other) noexcept;
+
+    // Заводит пустой список статуса при первом обращении.
+    PostingList& Get(DocumentStatus status);
+
+    // PostingList::RenumberDocuments для всех непустых списков.
+    void RenumberDocuments(const std::vector<int>& new_ids);
+
+    // nullptr, если документов с таким статусом у слова нет.
+    const PostingList* Find(DocumentStatus status) const noexcept;
+
+    bool Contains(DocumentStatus status, int document_id) const;
+
+    // IDF для версии индекса index_version, в которой document_count документов.
+    // Безопасно вызывать из нескольких потоков.
+    double GetInverseDocumentFreq(uint64_t index_version, int document_count) const;
+
+    size_t GetMemoryUsage() const noexcept;
+
+    size_t GetUnusedCapacity() const noexcept;
+
+    // Заодно освобождает списки статусов, в которых не осталось документов.
+    void ShrinkToFit();
+
+    // Число документов со словом во всех списках.
+    size_t size() const noexcept;
+
+    bool empty() const noexcept {
+        return size() == 0;
+    }
+
+private:
+    static constexpr uint64_t NO_INDEX_VERSION = UINT64_MAX;
+
+    PostingList actual_;
+    // Списки IRRELEVANT, BANNED и REMOVED или ничего.
+    std::vector<PostingList> other_statuses_;
+
+    mutable std::atomic<uint64_t> idf_index_version_ = NO_INDEX_VERSION;
+    mutable std::atomic<double> inverse_document_freq_ = 0.0;
+};
+
+// Курсор для обхода постинг-листа документ за документом. Раскодирует по
+// одному блоку за раз, умеет перескакивать к заданному document_id целыми
+// блоками и оценивать сверху term_freq в блоке по его заголовку. Может быть
+// ограничен диапазоном document_id [first_document_id, last_document_id].
+class PostingCursor {
+public:
+    explicit PostingCursor(const PostingList& list);
+
+    PostingCursor(const PostingList& list, double inverse_document_freq, int first_document_id, int last_document_id);
+
+    bool IsEnd() const noexcept {
+        return is_end_;
+    }
+
+    int GetDocumentId() const noexcept {
+        return decoded_.document_ids[position_];
+    }
+
+    double GetTermFreq() const noexcept {
+        return decoded_.term_freqs[position_];
+    }
+
+    // Вклад текущего постинга в релевантность: term_freq * IDF.
+    double GetImpact() const noexcept {
+        return decoded_.term_freqs[position_] * inverse_document_freq_;
+    }
+
+    void Next();
+
+    // Сдвигает курсор на первый постинг с id не меньше document_id.
+    void NextGeq(int document_id);
+
+    // Максимальная term_freq в блоке, где мог бы лежать document_id,
+    // или 0, если таких блоков в списке не осталось.
+    double GetBlockMaxTermFreq(int document_id);
+
+private:
+    const PostingList* list_;
+    double inverse_document_freq_ = 0.0;
+    int last_document_id_;
+    size_t block_ = 0;
+    size_t shallow_block_ = 0;
+    size_t position_ = 0;
+    bool is_end_ = false;
+    PostingList::DecodedBlock decoded_;
+
+    void LoadBlock(size_t block_index);
+
+    void CheckEnd();
+};
@@ -4,45 +4,84 @@
 #include <vector>
 #include <deque>
 #include <execution>
+#include <mutex>
 
-std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries) {
-    std::vector<std::vector<Document>> results(queries.size());
+namespace {
 
-    std::vector<std::string_view> queries_sv;
-    queries_sv.reserve(queries.size());
-    for (const std::string& query : queries) {
-        queries_sv.push_back(query);
-    }
+QueryExecutor& GetDefaultExecutor() {
+    static QueryExecutor executor;
+    return executor;
+}
 
-    std::transform(std::execution::par,
-        queries_sv.cbegin(), queries_sv.cend(),
-        results.begin(),
-        [&search_server](std::string_view query) noexcept{
-            return search_server.FindTopDocuments(query);
-        });
+} // namespace
+
+std::vector<std::vector<Document>> ProcessQueries(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries) {
+    std::vector<std::vector<Document>> results(queries.size());
+
+    executor.ParallelFor(queries.size(), [&search_server, &queries, &results](size_t, size_t i) {
+        thread_local SearchServer::QueryBuffers buffers;
+        results[i] = search_server.FindTopDocuments(queries[i], DocumentStatus::ACTUAL, buffers);
+    });
 
     return results;
 }
 
+std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    return ProcessQueries(GetDefaultExecutor(), search_server, queries);
+}
+
 std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries) {
-    const std::vector<std::vector<Document>> results = ProcessQueries(search_server, queries);
-
-    size_t documents_count = std::transform_reduce(std::execution::par,
-                                results.cbegin(), results.cend(),
-                                static_cast<size_t>(0),
-                                std::plus{},
-                                [](const std::vector<Document>& result) noexcept {
-                                    return result.size();
-                                });
-
-    std::vector<Document> vec(documents_count);
-
-    auto it = vec.begin();
-    std::for_each(std::execution::seq,
-        results.begin(), results.end(),
-        [&vec, &it](const std::vector<Document>& result) noexcept {
-            it = std::copy(std::execution::par, result.cbegin(), result.cend(), it);
+    return ProcessQueriesJoined(GetDefaultExecutor(), search_server, queries);
+}
+
+std::vector<Document> ProcessQueriesJoined(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries) {
+    std::vector<Document> documents;
+    ProcessQueriesJoined(executor, search_server, queries, [&documents](const Document& document) {
+        documents.push_back(document);
+    });
+    return documents;
+}
+
+// Запросы обрабатываются окнами, поэтому в памяти одновременно лежат
+// результаты не больше чем одного окна. Закончив запрос, поток отдаёт
+// в sink все готовые результаты подряд, начиная с первого ещё не отданного.
+// Делается это под мьютексом, так что sink вызывается строго по порядку.
+void ProcessQueriesJoined(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries,
+                          const std::function<void(const Document&)>& sink) {
+    static constexpr size_t WINDOW_SIZE_PER_WORKER = 256;
+    const size_t window_size = executor.GetWorkerCount() * WINDOW_SIZE_PER_WORKER;
+
+    std::vector<std::vector<Document>> results(std::min(window_size, queries.size()));
+    std::vector<char> is_ready(results.size());
+    std::mutex emit_mutex;
+    for (size_t window_begin = 0; window_begin < queries.size(); window_begin += window_size) {
+        const size_t window_end = std::min(window_begin + window_size, queries.size());
+        std::fill(is_ready.begin(), is_ready.end(), false);
+        size_t next_to_emit = window_begin;
+        bool is_sink_failed = false;
+
+        executor.ParallelFor(window_end - window_begin, [&](size_t, size_t i) {
+            thread_local SearchServer::QueryBuffers buffers;
+            results[i] = search_server.FindTopDocuments(queries[window_begin + i], DocumentStatus::ACTUAL, buffers);
+
+            std::lock_guard guard(emit_mutex);
+            is_ready[i] = true;
+            while (!is_sink_failed && next_to_emit < window_end && is_ready[next_to_emit - window_begin]) {
+                std::vector<Document>& result = results[next_to_emit - window_begin];
+                try {
+                    std::for_each(result.begin(), result.end(), sink);
+                } catch (...) {
+                    is_sink_failed = true;
+                    throw;
+                }
+                result = {};
+                ++next_to_emit;
+            }
         });
+    }
+}
 
-    return vec;
-}
\ No newline at end of file
+void ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries,
+                          const std::function<void(const Document&)>& sink) {
+    ProcessQueriesJoined(GetDefaultExecutor(), search_server, queries, sink);
+}
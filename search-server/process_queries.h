@@ -1,14 +1,46 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 
 #include "document.h"
 #include "search_server.h"
+#include "query_executor.h"
 
+// Запросы выполняются на executor; у каждого его потока свои буферы поиска,
+// которые переиспользуются между запросами и пакетами.
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Использует общий пул на все доступные процессу ядра.
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
 std::vector<Document> ProcessQueriesJoined(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+std::vector<Document> ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Отдаёт найденные документы в sink по мере готовности, в том же порядке,
+// что и ProcessQueriesJoined, не дожидаясь конца пакета. Память под
+// результаты ограничена окном из нескольких сотен запросов на поток
+// executor. sink никогда не вызывается одновременно из двух потоков, но
+// вызывается из потоков executor; исключение из sink останавливает выдачу
+// и пробрасывается вызывающему.
+void ProcessQueriesJoined(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    const std::function<void(const Document&)>& sink);
+
+void ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries); 
\ No newline at end of file
+    const std::vector<std::string>& queries,
+    const std::function<void(const Document&)>& sink);
@@ -0,0 +1,141 @@
+#include "query_executor.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+size_t GetAvailableCoreCount() {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+        return std::max(CPU_COUNT(&cpu_set), 1);
+    }
+#endif
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+QueryExecutor::QueryExecutor(size_t worker_count) {
+    worker_count = std::max<size_t>(worker_count, 1);
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_[i]->thread = std::thread([this, i] {
+            Run(i);
+        });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (const auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+// Кусков в несколько раз больше, чем потоков: если какой-то поток отстанет,
+// остальные доделают его работу.
+void QueryExecutor::ParallelFor(size_t count, const std::function<void(size_t, size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    static constexpr size_t CHUNKS_PER_WORKER = 8;
+    const size_t chunk_size = std::max<size_t>(count / (workers_.size() * CHUNKS_PER_WORKER), 1);
+    const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    Batch batch;
+    batch.task = &task;
+    batch.remaining = count;
+    {
+        std::lock_guard guard(sleep_mutex_);
+        queued_chunk_count_ += chunk_count;
+    }
+    for (size_t i = 0; i < chunk_count; ++i) {
+        Worker& worker = *workers_[i % workers_.size()];
+        std::lock_guard guard(worker.mutex);
+        worker.chunks.push_back({&batch, i * chunk_size, std::min((i + 1) * chunk_size, count)});
+    }
+    wake_up_.notify_all();
+
+    std::unique_lock lock(batch.mutex);
+    batch.done.wait(lock, [&batch] {
+        return batch.remaining == 0;
+    });
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void QueryExecutor::Run(size_t worker_index) {
+    while (true) {
+        Chunk chunk;
+        if (PopChunk(worker_index, chunk)) {
+            RunChunk(worker_index, chunk);
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return is_stopping_ || queued_chunk_count_ > 0;
+        });
+        if (queued_chunk_count_ == 0) {
+            return;
+        }
+    }
+}
+
+bool QueryExecutor::PopChunk(size_t worker_index, Chunk& chunk) {
+    bool is_found = false;
+    {
+        Worker& worker = *workers_[worker_index];
+        std::lock_guard guard(worker.mutex);
+        if (!worker.chunks.empty()) {
+            chunk = worker.chunks.back();
+            worker.chunks.pop_back();
+            is_found = true;
+        }
+    }
+    for (size_t i = 1; !is_found && i < workers_.size(); ++i) {
+        Worker& victim = *workers_[(worker_index + i) % workers_.size()];
+        std::lock_guard guard(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            is_found = true;
+        }
+    }
+    if (is_found) {
+        std::lock_guard guard(sleep_mutex_);
+        --queued_chunk_count_;
+    }
+    return is_found;
+}
+
+// Счётчик уменьшается под мьютексом пакета: иначе ожидающий поток мог бы
+// увидеть ноль и уничтожить пакет, пока этот поток ещё будит его.
+void QueryExecutor::RunChunk(size_t worker_index, const Chunk& chunk) {
+    Batch& batch = *chunk.batch;
+    for (size_t i = chunk.begin; i < chunk.end; ++i) {
+        try {
+            (*batch.task)(worker_index, i);
+        } catch (...) {
+            std::lock_guard guard(batch.mutex);
+            if (!batch.error) {
+                batch.error = std::current_exception();
+            }
+        }
+    }
+
+    std::lock_guard guard(batch.mutex);
+    batch.remaining -= chunk.end - chunk.begin;
+    if (batch.remaining == 0) {
+        batch.done.notify_all();
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+#include "concurrent_map.h"
+
+// Число ядер, на которых процессу разрешено работать. В Linux учитывает
+// маску привязки процесса, поэтому в контейнере с ограниченным набором
+// ядер возвращает их число, а не число ядер машины.
+size_t GetAvailableCoreCount();
+
+// Пул потоков с перехватом работы. Пакет из count задач делится на куски,
+// которые раскладываются по очередям потоков; поток берёт куски из хвоста
+// своей очереди, а опустев, забирает их из головы чужих. Задаче передаётся
+// номер потока, поэтому у каждого потока могут быть свои буферы.
+class QueryExecutor {
+public:
+    explicit QueryExecutor(size_t worker_count = GetAvailableCoreCount());
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    ~QueryExecutor();
+
+    size_t GetWorkerCount() const noexcept {
+        return workers_.size();
+    }
+
+    // Вызывает task(worker_index, i) для всех i из [0, count) и ждёт окончания.
+    // Первое из брошенных задачами исключений пробрасывается вызывающему.
+    // Можно вызывать из нескольких потоков одновременно, но не из самих задач.
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& task);
+
+private:
+    struct Batch {
+        const std::function<void(size_t, size_t)>* task;
+        // Число ещё не выполненных задач; защищено mutex.
+        size_t remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    struct Chunk {
+        Batch* batch;
+        size_t begin;
+        size_t end;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Worker {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    size_t queued_chunk_count_ = 0;
+    bool is_stopping_ = false;
+
+    void Run(size_t worker_index);
+
+    bool PopChunk(size_t worker_index, Chunk& chunk);
+
+    void RunChunk(size_t worker_index, const Chunk& chunk);
+};
@@ -0,0 +1,209 @@
+#include "query_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "concurrent_map.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+template <typename T>
+void Increase(std::atomic<T>& counter, T value) {
+    // Пишет в гистограмму только один поток, поэтому атомарное сложение не нужно.
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+} // namespace
+
+void HdrHistogram::Record(uint64_t value) noexcept {
+    Increase<uint64_t>(bins_[GetBin(value)], 1);
+    Increase<uint64_t>(total_, value);
+}
+
+void HdrHistogram::Reset() noexcept {
+    for (std::atomic<uint64_t>& bin : bins_) {
+        bin.store(0, std::memory_order_relaxed);
+    }
+    total_.store(0, std::memory_order_relaxed);
+}
+
+void HdrHistogram::Add(const HdrHistogram& other) noexcept {
+    for (size_t bin = 0; bin < BIN_COUNT; ++bin) {
+        Increase<uint64_t>(bins_[bin], other.bins_[bin].load(std::memory_order_relaxed));
+    }
+    Increase<uint64_t>(total_, other.total_.load(std::memory_order_relaxed));
+}
+
+uint64_t HdrHistogram::GetCount() const noexcept {
+    uint64_t count = 0;
+    for (const std::atomic<uint64_t>& bin : bins_) {
+        count += bin.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t HdrHistogram::GetPercentile(double fraction) const noexcept {
+    const uint64_t count = GetCount();
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * count)));
+    uint64_t seen = 0;
+    for (size_t bin = 0; bin < BIN_COUNT; ++bin) {
+        seen += bins_[bin].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return GetBinUpperBound(bin);
+        }
+    }
+    return GetBinUpperBound(BIN_COUNT - 1);
+}
+
+size_t HdrHistogram::GetBin(uint64_t value) noexcept {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    const int exponent = 63 - __builtin_clzll(value);
+    const int shift = exponent - SUB_BUCKET_BITS;
+    return SUB_BUCKET_COUNT + static_cast<size_t>(shift) * SUB_BUCKET_COUNT + ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t HdrHistogram::GetBinUpperBound(size_t bin) noexcept {
+    if (bin < SUB_BUCKET_COUNT) {
+        return bin;
+    }
+    const size_t shift = (bin - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+    const uint64_t sub_bucket = (bin - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+    return ((SUB_BUCKET_COUNT + sub_bucket + 1) << shift) - 1;
+}
+
+#ifdef SEARCH_SERVER_METRICS
+
+namespace {
+
+struct alignas(CACHE_LINE_SIZE) ThreadQueryMetrics {
+    std::array<HdrHistogram, QUERY_STAGE_COUNT> stage_nanoseconds;
+    HdrHistogram postings_scanned;
+    HdrHistogram documents_scored;
+};
+
+// Метрики потоков живут до конца программы: снимок может понадобиться
+// и после того, как поток завершился.
+struct QueryMetricsRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadQueryMetrics>> threads;
+};
+
+QueryMetricsRegistry& GetRegistry() {
+    static QueryMetricsRegistry registry;
+    return registry;
+}
+
+ThreadQueryMetrics& GetThreadQueryMetrics() {
+    thread_local ThreadQueryMetrics* metrics = nullptr;
+    if (!metrics) {
+        QueryMetricsRegistry& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+        metrics = registry.threads.emplace_back(std::make_unique<ThreadQueryMetrics>()).get();
+    }
+    return *metrics;
+}
+
+} // namespace
+
+void QueryTrace::Merge(QueryTrace& other) noexcept {
+    other.Pause();
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        stage_durations_[stage] += other.stage_durations_[stage];
+    }
+    visited_stages_ |= other.visited_stages_;
+    postings_scanned_ += other.postings_scanned_;
+    documents_scored_ += other.documents_scored_;
+    other = QueryTrace();
+}
+
+void QueryTrace::Finish() noexcept {
+    Pause();
+    ThreadQueryMetrics& metrics = GetThreadQueryMetrics();
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        if (visited_stages_ & (1u << stage)) {
+            metrics.stage_nanoseconds[stage].Record(
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stage_durations_[stage]).count()));
+        }
+    }
+    metrics.postings_scanned.Record(postings_scanned_);
+    metrics.documents_scored.Record(documents_scored_);
+    *this = QueryTrace();
+}
+
+void QueryTrace::Pause() noexcept {
+    if (is_running_) {
+        stage_durations_[static_cast<size_t>(stage_)] += Clock::now() - stage_start_;
+        is_running_ = false;
+    }
+}
+
+std::string GetQueryMetricsSnapshot() {
+    static const char* const STAGE_NAMES[QUERY_STAGE_COUNT] = {
+        "parse", "posting_scan", "filter", "minus_words", "top_k", "result_copy",
+    };
+
+    std::array<HdrHistogram, QUERY_STAGE_COUNT> stage_nanoseconds;
+    HdrHistogram postings_scanned;
+    HdrHistogram documents_scored;
+    {
+        QueryMetricsRegistry& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+        for (const auto& metrics : registry.threads) {
+            for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+                stage_nanoseconds[stage].Add(metrics->stage_nanoseconds[stage]);
+            }
+            postings_scanned.Add(metrics->postings_scanned);
+            documents_scored.Add(metrics->documents_scored);
+        }
+    }
+
+    std::ostringstream out;
+    const auto print = [&out](const std::string& name, const HdrHistogram& histogram) {
+        out << name << ": count="s << histogram.GetCount()
+            << " p50="s << histogram.GetPercentile(0.5)
+            << " p90="s << histogram.GetPercentile(0.9)
+            << " p99="s << histogram.GetPercentile(0.99)
+            << " max="s << histogram.GetPercentile(1.0)
+            << " total="s << histogram.GetTotal() << '\n';
+    };
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        print("stage_ns."s + STAGE_NAMES[stage], stage_nanoseconds[stage]);
+    }
+    print("postings_scanned"s, postings_scanned);
+    print("documents_scored"s, documents_scored);
+    return out.str();
+}
+
+void ResetQueryMetrics() {
+    QueryMetricsRegistry& registry = GetRegistry();
+    std::lock_guard guard(registry.mutex);
+    for (const auto& metrics : registry.threads) {
+        for (HdrHistogram& histogram : metrics->stage_nanoseconds) {
+            histogram.Reset();
+        }
+        metrics->postings_scanned.Reset();
+        metrics->documents_scored.Reset();
+    }
+}
+
+#else
+
+std::string GetQueryMetricsSnapshot() {
+    return "query metrics are disabled, build with SEARCH_SERVER_METRICS\n"s;
+}
+
+void ResetQueryMetrics() {
+}
+
+#endif
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Метрики поиска собираются, только если сервер собран с флагом
+// SEARCH_SERVER_METRICS. Без него QueryTrace пуст и вызовы его методов
+// компилятор убирает целиком.
+#ifdef SEARCH_SERVER_METRICS
+inline constexpr bool QUERY_METRICS_ENABLED = true;
+#else
+inline constexpr bool QUERY_METRICS_ENABLED = false;
+#endif
+
+// Этапы FindTopDocuments. Отбор кандидатов переключается между обходом
+// постингов, фильтром и проверкой минус-слов для каждого документа.
+enum class QueryStage {
+    PARSE,
+    POSTING_SCAN,
+    FILTER,
+    MINUS_WORDS,
+    TOP_K,
+    RESULT_COPY,
+};
+
+inline constexpr size_t QUERY_STAGE_COUNT = 6;
+
+// Гистограмма в духе HDR: значения до 16 хранятся точно, дальше каждая
+// степень двойки делится на 16 корзин, так что относительная ошибка
+// не больше 1/16. Пишет в неё один поток, читать можно из любого.
+class HdrHistogram {
+public:
+    void Record(uint64_t value) noexcept;
+
+    void Reset() noexcept;
+
+    uint64_t GetCount() const noexcept;
+
+    // Прибавляет значения other; сама гистограмма должна быть локальной.
+    void Add(const HdrHistogram& other) noexcept;
+
+    uint64_t GetTotal() const noexcept {
+        return total_.load(std::memory_order_relaxed);
+    }
+
+    // Верхняя граница корзины, в которую попало значение ранга
+    // ceil(fraction * count), или 0 для пустой гистограммы.
+    uint64_t GetPercentile(double fraction) const noexcept;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BIN_COUNT = SUB_BUCKET_COUNT + (64 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+
+    std::array<std::atomic<uint64_t>, BIN_COUNT> bins_{};
+    std::atomic<uint64_t> total_ = 0;
+
+    static size_t GetBin(uint64_t value) noexcept;
+
+    static uint64_t GetBinUpperBound(size_t bin) noexcept;
+};
+
+// Текстовый снимок метрик всех потоков: для каждого этапа — распределение
+// времени на запрос в наносекундах, для счётчиков — распределение значений
+// на запрос и их сумма.
+std::string GetQueryMetricsSnapshot();
+
+void ResetQueryMetrics();
+
+#ifdef SEARCH_SERVER_METRICS
+
+// Трасса одного запроса. Begin закрывает текущий этап и начинает новый,
+// так что на переключение этапа уходит одно чтение часов. Finish
+// записывает накопленное в гистограммы потока и очищает трассу.
+class QueryTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void Begin(QueryStage stage) noexcept {
+        const Clock::time_point now = Clock::now();
+        if (is_running_) {
+            stage_durations_[static_cast<size_t>(stage_)] += now - stage_start_;
+        }
+        stage_ = stage;
+        stage_start_ = now;
+        is_running_ = true;
+        visited_stages_ |= 1u << static_cast<uint32_t>(stage);
+    }
+
+    void AddPostingsScanned(uint64_t count) noexcept {
+        postings_scanned_ += count;
+    }
+
+    void AddDocumentScored() noexcept {
+        ++documents_scored_;
+    }
+
+    // Останавливает часы до следующего Begin, например пока части запроса
+    // выполняются в других потоках.
+    void Pause() noexcept;
+
+    // Добавляет время и счётчики трассы, которую вёл другой поток
+    // над частью того же запроса, и очищает её. Время параллельных
+    // этапов поэтому суммируется по потокам.
+    void Merge(QueryTrace& other) noexcept;
+
+    void Finish() noexcept;
+
+    // Очищает трассу, ничего не записывая.
+    void Reset() noexcept {
+        *this = QueryTrace();
+    }
+
+private:
+    std::array<Clock::duration, QUERY_STAGE_COUNT> stage_durations_{};
+    Clock::time_point stage_start_;
+    QueryStage stage_ = QueryStage::PARSE;
+    bool is_running_ = false;
+    // Этапы, в которых запрос побывал; только они попадают в гистограммы.
+    uint32_t visited_stages_ = 0;
+    uint64_t postings_scanned_ = 0;
+    uint64_t documents_scored_ = 0;
+};
+
+#else
+
+class QueryTrace {
+public:
+    void Begin(QueryStage) noexcept { }
+    void AddPostingsScanned(uint64_t) noexcept { }
+    void AddDocumentScored() noexcept { }
+    void Pause() noexcept { }
+    void Merge(QueryTrace&) noexcept { }
+    void Finish() noexcept { }
+    void Reset() noexcept { }
+};
+
+#endif
+
+// Очищает трассу запроса, прерванного исключением. Иначе её этапы
+// и простой до следующего запроса в тех же буферах попали бы
+// в гистограммы следующего запроса. После Finish очищать уже нечего.
+class QueryTraceGuard {
+public:
+    explicit QueryTraceGuard(QueryTrace& trace) noexcept
+        : trace_(trace)
+    {
+    }
+
+    QueryTraceGuard(const QueryTraceGuard&) = delete;
+    QueryTraceGuard& operator=(const QueryTraceGuard&) = delete;
+
+    ~QueryTraceGuard() {
+        trace_.Reset();
+    }
+
+private:
+    QueryTrace& trace_;
+};
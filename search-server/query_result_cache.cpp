@@ -0,0 +1,103 @@
+#include "query_result_cache.h"
+
+#include <algorithm>
+
+size_t QueryCacheKeyHash::operator()(const QueryCacheKey& key) const noexcept {
+    uint64_t hash = static_cast<uint64_t>(key.status) + 1;
+    const auto combine = [&hash](uint64_t value) {
+        hash = (hash ^ value) * 0x100000001B3ull;
+    };
+    for (const TermId term_id : key.plus_words) {
+        combine(term_id);
+    }
+    combine(TermDictionary::NO_TERM);
+    for (const TermId term_id : key.minus_words) {
+        combine(term_id);
+    }
+    return static_cast<size_t>(hash ^ (hash >> 29));
+}
+
+QueryResultCache::QueryResultCache(size_t capacity)
+    : capacity_(capacity)
+    , shard_count_(std::min(capacity, MAX_SHARD_COUNT))
+    , shards_(capacity == 0 ? nullptr : new Shard[shard_count_])
+{
+    for (size_t i = 0; i < shard_count_; ++i) {
+        shards_[i].capacity = capacity / shard_count_ + (i < capacity % shard_count_ ? 1 : 0);
+    }
+}
+
+QueryResultCache::QueryResultCache(const QueryResultCache& other)
+    : QueryResultCache(other.capacity_)
+{
+}
+
+QueryResultCache& QueryResultCache::operator=(const QueryResultCache& other) {
+    if (this != &other) {
+        QueryResultCache empty(other.capacity_);
+        capacity_ = empty.capacity_;
+        shard_count_ = empty.shard_count_;
+        shards_ = std::move(empty.shards_);
+    }
+    return *this;
+}
+
+std::optional<std::vector<Document>> QueryResultCache::Find(const QueryCacheKey& key, uint64_t index_version, const std::vector<double>& inverse_document_freqs) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        ++shard.miss_count;
+        return std::nullopt;
+    }
+    if (it->second.index_version != index_version || it->second.inverse_document_freqs != inverse_document_freqs) {
+        shard.recency.erase(it->second.position);
+        shard.entries.erase(it);
+        ++shard.miss_count;
+        return std::nullopt;
+    }
+    shard.recency.splice(shard.recency.begin(), shard.recency, it->second.position);
+    ++shard.hit_count;
+    return it->second.documents;
+}
+
+void QueryResultCache::Insert(QueryCacheKey key, uint64_t index_version, std::vector<double> inverse_document_freqs, std::vector<Document> documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    Entry entry{index_version, std::move(inverse_document_freqs), std::move(documents), {}};
+    auto [it, is_inserted] = shard.entries.try_emplace(std::move(key), std::move(entry));
+    if (!is_inserted) {
+        // Тот же запрос успел посчитать другой поток или запись устарела.
+        it->second.index_version = entry.index_version;
+        it->second.inverse_document_freqs = std::move(entry.inverse_document_freqs);
+        it->second.documents = std::move(entry.documents);
+        shard.recency.splice(shard.recency.begin(), shard.recency, it->second.position);
+        return;
+    }
+    shard.recency.push_front(&it->first);
+    it->second.position = shard.recency.begin();
+    if (shard.entries.size() > shard.capacity) {
+        const auto oldest = shard.entries.find(*shard.recency.back());
+        shard.recency.pop_back();
+        shard.entries.erase(oldest);
+    }
+}
+
+QueryCacheStats QueryResultCache::GetStats() const {
+    QueryCacheStats stats;
+    if (!IsEnabled()) {
+        return stats;
+    }
+    for (size_t i = 0; i < shard_count_; ++i) {
+        const Shard& shard = shards_[i];
+        std::lock_guard guard(shard.mutex);
+        stats.hit_count += shard.hit_count;
+        stats.miss_count += shard.miss_count;
+        stats.entry_count += shard.entries.size();
+    }
+    return stats;
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const QueryCacheKey& key) const {
+    return shards_[QueryCacheKeyHash{}(key) % shard_count_];
+}
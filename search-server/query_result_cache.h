@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <optional>
+
+#include "document.h"
+#include "term_dictionary.h"
+#include "concurrent_map.h"
+
+// Разобранный запрос: отсортированные и очищенные от повторов плюс-
+// и минус-слова вместе со статусом искомых документов.
+struct QueryCacheKey {
+    std::vector<TermId> plus_words;
+    std::vector<TermId> minus_words;
+    DocumentStatus status;
+
+    bool operator==(const QueryCacheKey& other) const {
+        return status == other.status && plus_words == other.plus_words && minus_words == other.minus_words;
+    }
+};
+
+struct QueryCacheKeyHash {
+    size_t operator()(const QueryCacheKey& key) const noexcept;
+};
+
+struct QueryCacheStats {
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    size_t entry_count = 0;
+
+    double GetHitRate() const noexcept {
+        const size_t lookup_count = hit_count + miss_count;
+        return lookup_count == 0 ? 0.0 : static_cast<double>(hit_count) / lookup_count;
+    }
+};
+
+// Кэш результатов поиска, поделенный на шарды с LRU-вытеснением в каждом.
+// Ёмкость делится между шардами без округления вверх, так что всего
+// записей не больше capacity; шардов не больше, чем записей.
+// Запись помнит версию индекса и IDF плюс-слов, с которыми посчитана;
+// после изменения индекса или IDF она перестаёт находиться и удаляется
+// при первом обращении.
+// Копия кэша пуста и имеет ту же ёмкость: версии индексов разных серверов
+// между собой не сравнимы.
+class QueryResultCache {
+public:
+    explicit QueryResultCache(size_t capacity = 0);
+
+    QueryResultCache(const QueryResultCache& other);
+    QueryResultCache& operator=(const QueryResultCache& other);
+
+    bool IsEnabled() const noexcept {
+        return capacity_ != 0;
+    }
+
+    std::optional<std::vector<Document>> Find(const QueryCacheKey& key, uint64_t index_version, const std::vector<double>& inverse_document_freqs);
+
+    void Insert(QueryCacheKey key, uint64_t index_version, std::vector<double> inverse_document_freqs, std::vector<Document> documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    static constexpr size_t MAX_SHARD_COUNT = 16;
+
+    struct Entry {
+        uint64_t index_version;
+        std::vector<double> inverse_document_freqs;
+        std::vector<Document> documents;
+        // Место записи в очереди LRU шарда.
+        std::list<const QueryCacheKey*>::iterator position;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<QueryCacheKey, Entry, QueryCacheKeyHash> entries;
+        // Ключи записей, недавно использованные в начале.
+        std::list<const QueryCacheKey*> recency;
+        size_t capacity = 0;
+        size_t hit_count = 0;
+        size_t miss_count = 0;
+    };
+
+    size_t capacity_;
+    size_t shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+
+    Shard& GetShard(const QueryCacheKey& key) const;
+};
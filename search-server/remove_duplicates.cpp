@@ -1,33 +1,159 @@
 #include "remove_duplicates.h"
+#include "hash_utils.h"
 
-#include <vector>
-#include <set>
-#include <string>
+#include <algorithm>
+#include <execution>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
 
 using namespace std::string_literals;
 
-void RemoveDuplicates(SearchServer& search_server) {
-    std::vector<int> duplicates;
-    std::set<std::set<std::string>> unique_documents;
-    std::set<std::string> words;
+namespace {
 
-    for (const int document_id : search_server) {
-        words.clear();
+// Ключи полос сигнатуры MinHash. Хеш-функции семейства получаются
+// из двух базовых: g_k(x) = h1(x) + k * h2(x).
+void ComputeBandKeys(const std::vector<TermId>& term_ids, const NearDuplicateOptions& options, uint64_t* band_keys) {
+    thread_local std::vector<uint32_t> signature;
+    signature.assign(options.band_count * options.rows_per_band, UINT32_MAX);
+    for (const TermId term_id : term_ids) {
+        const uint64_t h1 = Mix(term_id + 0x9E3779B97F4A7C15ull);
+        const uint64_t h2 = Mix(term_id ^ 0xD6E8FEB86659FD93ull) | 1;
+        for (size_t k = 0; k < signature.size(); ++k) {
+            signature[k] = std::min(signature[k], static_cast<uint32_t>((h1 + k * h2) >> 32));
+        }
+    }
+    for (size_t band = 0; band < options.band_count; ++band) {
+        uint64_t key = band + 1;
+        for (size_t row = 0; row < options.rows_per_band; ++row) {
+            key = Mix(key ^ (key << 32) ^ signature[band * options.rows_per_band + row]);
+        }
+        band_keys[band] = key;
+    }
+}
 
-        for (const auto& pair : search_server.GetWordFrequencies(document_id)) {
-            words.insert(std::string(pair.first));
+double ComputeJaccardSimilarity(const std::vector<TermId>& lhs, const std::vector<TermId>& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t intersection = 0;
+    for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        } else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        } else {
+            ++intersection;
+            ++lhs_it;
+            ++rhs_it;
         }
+    }
+    return static_cast<double>(intersection) / (lhs.size() + rhs.size() - intersection);
+}
+
+} // namespace
+
+std::vector<int> FindDuplicates(const SearchServer& search_server) {
+    const std::vector<int> document_ids(search_server.cbegin(), search_server.cend());
+    std::vector<std::pair<DocumentFingerprint, int>> fingerprints(document_ids.size());
+    std::transform(std::execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(),
+        [&search_server](int document_id) {
+            return std::pair{search_server.GetDocumentFingerprint(document_id), document_id};
+        });
+    std::sort(std::execution::par, fingerprints.begin(), fingerprints.end());
 
-        if (unique_documents.count(words) > 0) {
-            duplicates.push_back(document_id);
-            std::cout << "Found duplicate document id "s << document_id << std::endl;
+    std::vector<int> duplicates;
+    for (size_t i = 1; i < fingerprints.size(); ++i) {
+        if (fingerprints[i].first == fingerprints[i - 1].first) {
+            duplicates.push_back(fingerprints[i].second);
         }
-        else {
-            unique_documents.insert(words);
-        }    
     }
+    std::sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
 
+void RemoveDuplicates(SearchServer& search_server) {
+    const std::vector<int> duplicates = FindDuplicates(search_server);
     for (const int document_id : duplicates) {
-        search_server.RemoveDocument(document_id);
+        std::cout << "Found duplicate document id "s << document_id << '\n';
+    }
+    std::cout.flush();
+    search_server.RemoveDocuments(std::execution::par, duplicates);
+}
+
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    if (options.band_count == 0 || options.rows_per_band == 0 || options.similarity_threshold > 1.0) {
+        throw std::invalid_argument("Invalid near-duplicate options"s);
+    }
+    const std::vector<int> document_ids(search_server.cbegin(), search_server.cend());
+    const size_t document_count = document_ids.size();
+    std::vector<size_t> indexes(document_count);
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    // Наборы слов нужны и для сигнатур, и для проверки кандидатов,
+    // поэтому строятся один раз.
+    std::vector<std::vector<TermId>> document_terms(document_count);
+    std::vector<uint64_t> band_keys(document_count * options.band_count);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        document_terms[i] = search_server.GetDocumentTerms(document_ids[i]);
+        ComputeBandKeys(document_terms[i], options, &band_keys[i * options.band_count]);
+    });
+
+    // Кандидаты — пары (первый документ корзины, другой документ корзины).
+    std::vector<std::pair<size_t, size_t>> candidates;
+    std::vector<std::pair<uint64_t, size_t>> buckets(document_count);
+    for (size_t band = 0; band < options.band_count; ++band) {
+        for (size_t i = 0; i < document_count; ++i) {
+            buckets[i] = {band_keys[i * options.band_count + band], i};
+        }
+        std::sort(std::execution::par, buckets.begin(), buckets.end());
+        for (size_t begin = 0, end = 0; begin < document_count; begin = end) {
+            for (end = begin + 1; end < document_count && buckets[end].first == buckets[begin].first; ++end) {
+                candidates.emplace_back(buckets[begin].second, buckets[end].second);
+            }
+        }
+    }
+    std::sort(std::execution::par, candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<char> is_similar(candidates.size());
+    std::transform(std::execution::par, candidates.begin(), candidates.end(), is_similar.begin(),
+        [&](const std::pair<size_t, size_t>& candidate) {
+            return ComputeJaccardSimilarity(document_terms[candidate.first], document_terms[candidate.second])
+                   >= options.similarity_threshold;
+        });
+
+    // Документы обходятся по возрастанию id. Ещё не попавший в группу
+    // документ становится центром и забирает свободных похожих на него.
+    // Кандидаты упорядочены по первому документу пары, а он меньше второго.
+    std::vector<char> is_grouped(document_count);
+    std::vector<std::vector<int>> clusters;
+    size_t candidate = 0;
+    for (size_t i = 0; i < document_count; ++i) {
+        std::vector<int> cluster;
+        for (; candidate < candidates.size() && candidates[candidate].first == i; ++candidate) {
+            const size_t other = candidates[candidate].second;
+            if (!is_grouped[i] && is_similar[candidate] && !is_grouped[other]) {
+                is_grouped[other] = true;
+                cluster.push_back(document_ids[other]);
+            }
+        }
+        if (!cluster.empty()) {
+            cluster.insert(cluster.begin(), document_ids[i]);
+            clusters.push_back(std::move(cluster));
+        }
+    }
+    return clusters;
+}
+
+std::vector<int> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    std::vector<int> removed_ids;
+    for (const std::vector<int>& cluster : FindNearDuplicates(search_server, options)) {
+        removed_ids.insert(removed_ids.end(), cluster.begin() + 1, cluster.end());
     }
-}
\ No newline at end of file
+    std::sort(removed_ids.begin(), removed_ids.end());
+    search_server.RemoveDocuments(std::execution::par, removed_ids);
+    return removed_ids;
+}
@@ -1,5 +1,37 @@
 #pragma once
 
+#include <vector>
+
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Id документов, набор слов которых совпадает с набором слов документа
+// с меньшим id, по возрастанию. Документы сравниваются по 128-битным
+// отпечаткам, которые считаются по прямому индексу параллельно.
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
+void RemoveDuplicates(SearchServer& search_server);
+
+struct NearDuplicateOptions {
+    // Минимальное сходство Жаккара наборов слов двух документов.
+    double similarity_threshold = 0.8;
+    // Сигнатура MinHash из band_count * rows_per_band значений делится на
+    // полосы; документы становятся кандидатами, если совпала хоть одна полоса.
+    size_t band_count = 16;
+    size_t rows_per_band = 8;
+};
+
+// Группы почти одинаковых документов. Группа — это её центр, документ
+// с наименьшим id, и документы, сходство Жаккара которых с центром
+// не ниже порога. Цепочки не склеиваются: если A похож на B, а B на C,
+// но A не похож на C, то C в группу A не попадёт. Документ, уже
+// попавший в группу, центром другой группы не становится.
+// Пары-кандидаты находятся через LSH по сигнатурам MinHash, без сравнения
+// всех пар. Каждый документ корзины сравнивается только с первым документом
+// корзины, поэтому поиск приближённый: часть похожих пар может быть упущена.
+// Id в группе и сами группы упорядочены по возрастанию.
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options = {});
+
+// Оставляет от каждой группы почти одинаковых документов её центр, так что
+// у каждого удалённого документа остаётся похожий на него. Возвращает id
+// удалённых документов.
+std::vector<int> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options = {});
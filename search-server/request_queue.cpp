@@ -1,34 +1,195 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_{search_server} { }
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+namespace {
+
+std::atomic<uint64_t> next_queue_id = 1;
+
+// Очередь, в буферы которой поток писал последней. Поток обычно работает
+// с одной очередью, поэтому мьютекс берётся только при первой записи.
+struct ThreadStatsCache {
+    uint64_t queue_id = 0;
+    void* stats = nullptr;
+};
+
+thread_local ThreadStatsCache thread_stats_cache;
+
+template <typename T>
+void Increment(std::atomic<T>& counter) {
+    // Пишет в счётчик только один поток, поэтому атомарное сложение не нужно.
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+RequestQueue::RequestQueue(const SearchServer& search_server)
+    : search_server_{search_server}
+    , start_time_(Clock::now())
+    , id_(next_queue_id.fetch_add(1))
+{ }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
+    const Clock::time_point start = Clock::now();
     const std::vector<Document> resp =  search_server_.FindTopDocuments(raw_query, status);
-    HandleResponse(resp);
+    const Clock::time_point finish = Clock::now();
+    RecordRequest(finish, finish - start, resp.empty());
     return resp;
 }
+
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    const std::vector<Document> resp = search_server_.FindTopDocuments(raw_query);
-    HandleResponse(resp);
-    return resp;
+    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+}
+
+void RequestQueue::RecordRequest(Clock::time_point time, Clock::duration latency, bool is_empty) {
+    ThreadStats& stats = GetThreadStats();
+    const Clock::duration since_start = std::max(time, start_time_) - start_time_;
+    const size_t latency_bin = GetLatencyBin(latency);
+    Record(stats.fine, since_start, latency_bin, is_empty);
+    Record(stats.coarse, since_start, latency_bin, is_empty);
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return no_results_request_;
+    return static_cast<int>(GetStats(RequestWindow::DAY).empty_result_count);
+}
+
+RequestWindowStats RequestQueue::GetStats(RequestWindow window) const {
+    return GetStats(window, Clock::now());
 }
 
-void RequestQueue::HandleResponse(const std::vector<Document>& resp) {
-    if (!requests_.empty() && min_in_day_ <= (++current_time_ - requests_.front().time) ) {
-        if (requests_.front().is_empty && no_results_request_ > 0) {
-            --no_results_request_;
+RequestWindowStats RequestQueue::GetStats(RequestWindow window, Clock::time_point now) const {
+    const Clock::duration since_start = std::max(now, start_time_) - start_time_;
+    RequestWindowStats stats;
+    std::array<uint64_t, LATENCY_BIN_COUNT> latency_bins{};
+    const auto collect = [&](const auto ThreadStats::* ring, size_t interval_count) {
+        std::lock_guard guard(threads_mutex_);
+        for (const auto& [_, thread_stats] : thread_stats_) {
+            Collect((*thread_stats).*ring, since_start, interval_count, stats, latency_bins);
         }
-        requests_.pop_front();
+    };
+    std::chrono::seconds window_length{0};
+    switch (window) {
+    case RequestWindow::MINUTE:
+        window_length = std::chrono::minutes(1);
+        collect(&ThreadStats::fine, 12);
+        break;
+    case RequestWindow::FIVE_MINUTES:
+        window_length = std::chrono::minutes(5);
+        collect(&ThreadStats::fine, 60);
+        break;
+    case RequestWindow::HOUR:
+        window_length = std::chrono::hours(1);
+        collect(&ThreadStats::coarse, 12);
+        break;
+    case RequestWindow::DAY:
+        window_length = std::chrono::hours(24);
+        collect(&ThreadStats::coarse, 288);
+        break;
+    default:
+        throw std::invalid_argument("Unknown request window"s);
     }
 
-    bool is_empty = resp.empty();
-    requests_.push_back({current_time_,is_empty});
+    if (stats.request_count == 0) {
+        return stats;
+    }
+    // Пока очередь моложе окна, запросы делятся на время её жизни.
+    const double seconds = std::max(1.0, std::min(std::chrono::duration<double>(window_length).count(),
+                                                  std::chrono::duration<double>(since_start).count()));
+    stats.requests_per_second = stats.request_count / seconds;
+    stats.empty_result_rate = static_cast<double>(stats.empty_result_count) / stats.request_count;
+
+    const auto percentile = [&](double fraction) {
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * stats.request_count)));
+        uint64_t count = 0;
+        for (size_t bin = 0; bin < LATENCY_BIN_COUNT; ++bin) {
+            count += latency_bins[bin];
+            if (count >= rank) {
+                return GetLatencyBinUpperBound(bin);
+            }
+        }
+        return GetLatencyBinUpperBound(LATENCY_BIN_COUNT - 1);
+    };
+    stats.latency_p50 = percentile(0.5);
+    stats.latency_p90 = percentile(0.9);
+    stats.latency_p99 = percentile(0.99);
+    stats.latency_max = percentile(1.0);
+    return stats;
+}
 
+RequestQueue::ThreadStats& RequestQueue::GetThreadStats() {
+    if (thread_stats_cache.queue_id == id_) {
+        return *static_cast<ThreadStats*>(thread_stats_cache.stats);
+    }
+    std::lock_guard guard(threads_mutex_);
+    std::unique_ptr<ThreadStats>& stats = thread_stats_[std::this_thread::get_id()];
+    if (!stats) {
+        stats = std::make_unique<ThreadStats>();
+    }
+    thread_stats_cache = {id_, stats.get()};
+    return *stats;
+}
+
+// Интервал, оставшийся от прошлого оборота кольца, сначала обнуляется.
+template <typename Ring>
+void RequestQueue::Record(Ring& ring, Clock::duration since_start, size_t latency_bin, bool is_empty) {
+    const uint64_t index = static_cast<uint64_t>(since_start / Ring::INTERVAL_LENGTH);
+    Interval& interval = ring.intervals[index % ring.intervals.size()];
+    if (interval.index.load(std::memory_order_relaxed) != index) {
+        interval.index.store(NO_INTERVAL, std::memory_order_relaxed);
+        interval.request_count.store(0, std::memory_order_relaxed);
+        interval.empty_result_count.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint32_t>& bin : interval.latency_bins) {
+            bin.store(0, std::memory_order_relaxed);
+        }
+        interval.index.store(index, std::memory_order_release);
+    }
+    Increment(interval.request_count);
     if (is_empty) {
-        ++no_results_request_;
+        Increment(interval.empty_result_count);
+    }
+    Increment(interval.latency_bins[latency_bin]);
+}
+
+template <typename Ring>
+void RequestQueue::Collect(const Ring& ring, Clock::duration since_start, size_t interval_count, RequestWindowStats& stats,
+                           std::array<uint64_t, LATENCY_BIN_COUNT>& latency_bins) const {
+    const uint64_t current = static_cast<uint64_t>(since_start / Ring::INTERVAL_LENGTH);
+    for (const Interval& interval : ring.intervals) {
+        const uint64_t index = interval.index.load(std::memory_order_acquire);
+        if (index == NO_INTERVAL || index > current || current - index >= interval_count) {
+            continue;
+        }
+        stats.request_count += interval.request_count.load(std::memory_order_relaxed);
+        stats.empty_result_count += interval.empty_result_count.load(std::memory_order_relaxed);
+        for (size_t bin = 0; bin < LATENCY_BIN_COUNT; ++bin) {
+            latency_bins[bin] += interval.latency_bins[bin].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Задержки до 16 мкс считаются точно, дальше каждая степень двойки
+// делится на четыре корзины.
+size_t RequestQueue::GetLatencyBin(Clock::duration latency) {
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    if (microseconds < 16) {
+        return static_cast<size_t>(std::max<int64_t>(microseconds, 0));
     }
-}
\ No newline at end of file
+    const uint64_t value = static_cast<uint64_t>(microseconds);
+    const int exponent = 63 - __builtin_clzll(value);
+    const size_t bin = 16 + static_cast<size_t>(exponent - 4) * 4 + ((value >> (exponent - 2)) & 3);
+    return std::min(bin, LATENCY_BIN_COUNT - 1);
+}
+
+std::chrono::microseconds RequestQueue::GetLatencyBinUpperBound(size_t bin) {
+    if (bin < 16) {
+        return std::chrono::microseconds(bin);
+    }
+    const int exponent = 4 + static_cast<int>(bin - 16) / 4;
+    const uint64_t quarter = (bin - 16) % 4;
+    return std::chrono::microseconds(static_cast<int64_t>((5 + quarter) << (exponent - 2)) - 1);
+}
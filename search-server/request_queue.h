@@ -2,16 +2,53 @@
 
 #include <vector>
 #include <string>
-#include <queue>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <cstdint>
 
 #include "document.h"
 #include "search_server.h"
+#include "concurrent_map.h"
 
+enum class RequestWindow {
+    MINUTE,
+    FIVE_MINUTES,
+    HOUR,
+    DAY,
+};
+
+struct RequestWindowStats {
+    size_t request_count = 0;
+    size_t empty_result_count = 0;
+    double requests_per_second = 0.0;
+    double empty_result_rate = 0.0;
+    // Перцентили задержки с точностью до четверти степени двойки.
+    std::chrono::microseconds latency_p50{0};
+    std::chrono::microseconds latency_p90{0};
+    std::chrono::microseconds latency_p99{0};
+    std::chrono::microseconds latency_max{0};
+};
+
+// Статистика запросов за скользящие окна реального времени. Можно вызывать
+// из многих потоков сразу: каждый поток пишет в собственные кольцевые
+// буферы интервалов и никого не ждёт, а чтение сводит буферы всех потоков.
+// Минута и пять минут считаются по пятисекундным интервалам, час и сутки —
+// по пятиминутным, так что граница окна точна до интервала. Запросы,
+// записанные во время чтения, могут учесться в нём частично.
 class RequestQueue {
 public:
+    using Clock = std::chrono::steady_clock;
+
     explicit RequestQueue(const SearchServer& search_server);
 
+    RequestQueue(const RequestQueue&) = delete;
+    RequestQueue& operator=(const RequestQueue&) = delete;
+
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
 
@@ -19,27 +56,69 @@ public:
 
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+    // Учитывает запрос, выполненный к моменту time за время latency.
+    void RecordRequest(Clock::time_point time, Clock::duration latency, bool is_empty);
+
+    // Число запросов без результатов за последние сутки.
     int GetNoResultRequests() const;
 
+    // Бросает std::invalid_argument для неизвестного окна.
+    RequestWindowStats GetStats(RequestWindow window) const;
+    RequestWindowStats GetStats(RequestWindow window, Clock::time_point now) const;
+
 private:
-    struct QueryResult {
-        uint64_t time;
-        bool is_empty;
+    static constexpr size_t LATENCY_BIN_COUNT = 112;
+    static constexpr uint64_t NO_INTERVAL = UINT64_MAX;
+
+    struct Interval {
+        std::atomic<uint64_t> index = NO_INTERVAL;
+        std::atomic<uint32_t> request_count = 0;
+        std::atomic<uint32_t> empty_result_count = 0;
+        std::array<std::atomic<uint32_t>, LATENCY_BIN_COUNT> latency_bins{};
+    };
+
+    // Кольцо из INTERVAL_COUNT интервалов длиной INTERVAL_LENGTH.
+    template <int64_t INTERVAL_SECONDS, size_t INTERVAL_COUNT>
+    struct IntervalRing {
+        static constexpr std::chrono::seconds INTERVAL_LENGTH{INTERVAL_SECONDS};
+        std::array<Interval, INTERVAL_COUNT> intervals;
     };
-    std::deque<QueryResult> requests_;
-
-    const class SearchServer & search_server_;
-    const static int min_in_day_ = 1440;
-    
-    uint64_t current_time_ = 0;
-    int no_results_request_ = 0;
-    
-    void HandleResponse(const std::vector<Document>& resp);
+
+    using FineRing = IntervalRing<5, 60>;
+    using CoarseRing = IntervalRing<300, 288>;
+
+    // Буферы одного потока; пишет в них только он.
+    struct alignas(CACHE_LINE_SIZE) ThreadStats {
+        FineRing fine;
+        CoarseRing coarse;
+    };
+
+    const SearchServer& search_server_;
+    const Clock::time_point start_time_;
+    // Уникален среди всех очередей процесса, в отличие от адреса.
+    const uint64_t id_;
+    mutable std::mutex threads_mutex_;
+    std::map<std::thread::id, std::unique_ptr<ThreadStats>> thread_stats_;
+
+    ThreadStats& GetThreadStats();
+
+    template <typename Ring>
+    void Record(Ring& ring, Clock::duration since_start, size_t latency_bin, bool is_empty);
+
+    template <typename Ring>
+    void Collect(const Ring& ring, Clock::duration since_start, size_t interval_count, RequestWindowStats& stats,
+                 std::array<uint64_t, LATENCY_BIN_COUNT>& latency_bins) const;
+
+    static size_t GetLatencyBin(Clock::duration latency);
+
+    static std::chrono::microseconds GetLatencyBinUpperBound(size_t bin);
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    const Clock::time_point start = Clock::now();
     const std::vector<Document> resp =  search_server_.FindTopDocuments(raw_query, document_predicate);
-    HandleResponse(resp);
+    const Clock::time_point finish = Clock::now();
+    RecordRequest(finish, finish - start, resp.empty());
     return resp;
-}
\ No newline at end of file
+}
@@ -1,9 +1,12 @@
 #include "search_server.h"
+#include "hash_utils.h"
+#include "index_snapshot.h"
 
+#include <array>
 #include <cmath>
-#include <deque>
 #include <string>
 #include <string_view>
+#include <thread>
 
 using namespace std::string_literals;
 
@@ -14,125 +17,634 @@ SearchServer::SearchServer(const std::string_view& stop_words_string) : SearchSe
 SearchServer::SearchServer(const std::string& stop_words_string) : SearchServer::SearchServer(std::string_view(stop_words_string)) { }
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-    if (document_id < 0) {
-        throw std::invalid_argument("Document id less than zero"s);
+    CheckNewDocumentId(document_id);
+    // Новый номер больше всех прежних, поэтому постинги дописываются в конец списков.
+    const int internal_id = GetNextInternalId(1);
+
+    thread_local std::vector<std::string_view> words;
+    SplitIntoWordsNoStop(document, words);
+
+    std::vector<TermId> term_ids;
+    term_ids.reserve(words.size());
+    for (const std::string_view& word : words) {
+        term_ids.push_back(terms_.Intern(word));
     }
+    if (word_to_document_freqs_.size() < terms_.size()) {
+        word_to_document_freqs_.resize(terms_.size());
+    }
+    std::sort(term_ids.begin(), term_ids.end());
 
-    if (documents_.count(document_id) != 0) {
-        throw std::invalid_argument("Document with this id already exists in the database"s);
+    const uint32_t word_count = static_cast<uint32_t>(words.size());
+    std::vector<TermCount> word_counts;
+    for (const TermId term_id : term_ids) {
+        if (word_counts.empty() || word_counts.back().term_id != term_id) {
+            word_counts.push_back({term_id, 0});
+        }
+        ++word_counts.back().count;
+    }
+    for (const auto [term_id, count] : word_counts) {
+        word_to_document_freqs_[term_id].Get(status).Add(internal_id, count, word_count);
     }
+    AppendDocument(document_id, ComputeAverageRating(ratings), status, word_count, std::move(word_counts));
+    ++index_version_;
+}
 
-    string_storage_.emplace_back(document);
+std::vector<std::exception_ptr> SearchServer::AddDocuments(std::execution::sequenced_policy policy, const std::vector<NewDocument>& documents) {
+    return AddDocumentsImpl(policy, documents);
+}
 
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(string_storage_.back());
+std::vector<std::exception_ptr> SearchServer::AddDocuments(std::execution::parallel_policy policy, const std::vector<NewDocument>& documents) {
+    return AddDocumentsImpl(policy, documents);
+}
 
-    const double inv_word_count = 1.0 / words.size();
-    for (const std::string_view& word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+std::vector<std::exception_ptr> SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    return AddDocuments(std::execution::seq, documents);
+}
+
+// Пакет добавляется в несколько проходов. Разбиение на слова и поиск их
+// в словаре идут параллельно по документам, в словарь последовательно
+// добавляются только новые слова, и в том же порядке, что и при вызовах
+// AddDocument по очереди. Затем документы, упорядоченные по id, делятся
+// на части, и для каждой части строятся свои постинги, отсортированные
+// по слову. Внутренние номера документам выдаются в том же порядке.
+// Наконец постинг-листы пополняются параллельно по диапазонам слов,
+// причём в каждый список постинги попадают по возрастанию номера.
+template <typename ExecutionPolicy>
+std::vector<std::exception_ptr> SearchServer::AddDocumentsImpl(ExecutionPolicy& policy, const std::vector<NewDocument>& documents) {
+    struct ParsedDocument {
+        std::vector<std::string_view> words;
+        std::vector<TermId> term_ids;
+        std::vector<TermCount> word_counts;
+    };
+
+    struct PendingPosting {
+        TermId term_id;
+        DocumentStatus status;
+        int internal_id;
+        uint32_t term_count;
+        uint32_t document_length;
+    };
+
+    std::vector<std::exception_ptr> errors(documents.size());
+    std::vector<size_t> accepted;
+    accepted.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        try {
+            CheckNewDocumentId(documents[i].id);
+            accepted.push_back(i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
-    ids_.insert(document_id);
+
+    std::vector<ParsedDocument> parsed(documents.size());
+    std::for_each(policy, accepted.begin(), accepted.end(), [&](size_t i) {
+        try {
+            SplitIntoWordsNoStop(documents[i].text, parsed[i].words);
+        } catch (...) {
+            errors[i] = std::current_exception();
+            return;
+        }
+        parsed[i].term_ids.reserve(parsed[i].words.size());
+        for (const std::string_view word : parsed[i].words) {
+            parsed[i].term_ids.push_back(terms_.Find(word));
+        }
+    });
+    // Повтор id проверяется после разбора и по порядку пакета: документ,
+    // который AddDocument отверг бы, не занимает id для следующих.
+    std::set<int> batch_ids;
+    for (const size_t i : accepted) {
+        if (errors[i] == nullptr && !batch_ids.insert(documents[i].id).second) {
+            errors[i] = std::make_exception_ptr(std::invalid_argument("Document with this id already exists in the database"s));
+        }
+    }
+    accepted.erase(std::remove_if(accepted.begin(), accepted.end(), [&errors](size_t i) { return errors[i] != nullptr; }),
+                   accepted.end());
+    const int first_internal_id = GetNextInternalId(accepted.size());
+
+    for (const size_t i : accepted) {
+        for (size_t j = 0; j < parsed[i].words.size(); ++j) {
+            if (parsed[i].term_ids[j] == TermDictionary::NO_TERM) {
+                parsed[i].term_ids[j] = terms_.Intern(parsed[i].words[j]);
+            }
+        }
+    }
+    if (word_to_document_freqs_.size() < terms_.size()) {
+        word_to_document_freqs_.resize(terms_.size());
+    }
+
+    std::sort(accepted.begin(), accepted.end(), [&documents](size_t lhs, size_t rhs) {
+        return documents[lhs].id < documents[rhs].id;
+    });
+
+    size_t chunk_count = 1;
+    if constexpr (!std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        chunk_count = std::clamp<size_t>(accepted.size() / 256, 1, std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4);
+    }
+    std::vector<std::vector<PendingPosting>> chunk_postings(chunk_count);
+    std::vector<size_t> chunk_indexes(chunk_count);
+    std::iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+    std::for_each(policy, chunk_indexes.begin(), chunk_indexes.end(), [&](size_t chunk) {
+        std::vector<PendingPosting>& postings = chunk_postings[chunk];
+        const size_t begin = accepted.size() * chunk / chunk_count;
+        const size_t end = accepted.size() * (chunk + 1) / chunk_count;
+        for (size_t k = begin; k < end; ++k) {
+            ParsedDocument& document = parsed[accepted[k]];
+            std::sort(document.term_ids.begin(), document.term_ids.end());
+            for (const TermId term_id : document.term_ids) {
+                if (document.word_counts.empty() || document.word_counts.back().term_id != term_id) {
+                    document.word_counts.push_back({term_id, 0});
+                }
+                ++document.word_counts.back().count;
+            }
+            const uint32_t word_count = static_cast<uint32_t>(document.words.size());
+            for (const auto [term_id, count] : document.word_counts) {
+                postings.push_back({term_id, documents[accepted[k]].status, first_internal_id + static_cast<int>(k), count, word_count});
+            }
+        }
+        std::stable_sort(postings.begin(), postings.end(), [](const PendingPosting& lhs, const PendingPosting& rhs) {
+            return lhs.term_id < rhs.term_id;
+        });
+    });
+
+    // Частые слова получают маленькие id, поэтому диапазонов берётся
+    // с запасом, чтобы потоки были загружены равномерно.
+    const size_t term_range_count = std::min<size_t>(chunk_count * 16, terms_.size());
+    std::vector<size_t> term_ranges(term_range_count);
+    std::iota(term_ranges.begin(), term_ranges.end(), 0);
+    std::for_each(policy, term_ranges.begin(), term_ranges.end(), [&](size_t range) {
+        const TermId first_term_id = static_cast<TermId>(terms_.size() * range / term_range_count);
+        const TermId last_term_id = static_cast<TermId>(terms_.size() * (range + 1) / term_range_count);
+        const auto less_term = [](const PendingPosting& posting, TermId term_id) {
+            return posting.term_id < term_id;
+        };
+        std::vector<typename std::vector<PendingPosting>::const_iterator> positions;
+        positions.reserve(chunk_count);
+        for (const std::vector<PendingPosting>& postings : chunk_postings) {
+            positions.push_back(std::lower_bound(postings.begin(), postings.end(), first_term_id, less_term));
+        }
+        std::array<std::vector<PostingList::Posting>, DOCUMENT_STATUS_COUNT> term_postings;
+        for (TermId term_id = first_term_id; term_id < last_term_id; ++term_id) {
+            for (std::vector<PostingList::Posting>& status_postings : term_postings) {
+                status_postings.clear();
+            }
+            for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+                auto& it = positions[chunk];
+                for (; it != chunk_postings[chunk].end() && it->term_id == term_id; ++it) {
+                    term_postings[static_cast<size_t>(it->status)].push_back({it->internal_id, it->term_count, it->document_length});
+                }
+            }
+            for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+                if (!term_postings[status].empty()) {
+                    word_to_document_freqs_[term_id].Get(static_cast<DocumentStatus>(status)).Add(term_postings[status]);
+                }
+            }
+        }
+    });
+
+    for (const size_t i : accepted) {
+        const NewDocument& document = documents[i];
+        AppendDocument(document.id, ComputeAverageRating(document.ratings), document.status,
+                       static_cast<uint32_t>(parsed[i].words.size()), std::move(parsed[i].word_counts));
+    }
+    if (!accepted.empty()) {
+        ++index_version_;
+    }
+    return errors;
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status) const {
     return FindTopDocuments(std::execution::seq, raw_query, document_status);
 }
 
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status, QueryBuffers& buffers) const {
+    return FindTopDocumentsWithStatus(std::execution::seq, raw_query, document_status, [this](TermId term_id) {
+        return ComputeWordInverseDocumentFreq(term_id);
+    }, buffers);
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    result_cache_ = QueryResultCache(capacity);
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return internal_ids_.size();
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) {
-    if (!documents_.count(document_id)) {
-        throw std::out_of_range("No document with this id"s);
-    }
+bool SearchServer::HasDocument(int document_id) const {
+    return internal_ids_.count(document_id) != 0;
+}
+
+size_t SearchServer::GetDocumentFreq(std::string_view word) const {
+    const TermId term_id = terms_.Find(word);
+    return term_id == TermDictionary::NO_TERM ? 0 : word_to_document_freqs_[term_id].size();
+}
 
-    string_storage_.emplace_back(raw_query);
-    const Query query = ParseQuery(string_storage_.back());
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) const {
+    const int internal_id = GetInternalId(document_id);
+    const Query query = ParseQuery(raw_query);
+    const DocumentStatus status = statuses_[internal_id];
     std::vector<std::string_view> matched_words;
     bool is_minus_word_in_document = false;
 
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+    for (const TermId term_id : query.minus_words) {
+        if (word_to_document_freqs_[term_id].Contains(status, internal_id)) {
             is_minus_word_in_document = true;
             break;
         }
     }
 
     if (!is_minus_word_in_document) {
-        for (std::string_view word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
-            }
-            if (word_to_document_freqs_.at(word).count(document_id)) {
-                matched_words.push_back(word);
+        for (const TermId term_id : query.plus_words) {
+            if (word_to_document_freqs_[term_id].Contains(status, internal_id)) {
+                matched_words.push_back(terms_.GetWord(term_id));
             }
         }
+        std::sort(matched_words.begin(), matched_words.end());
     }
     
-    return std::tuple(matched_words, documents_.at(document_id).status);
+    return std::tuple(matched_words, status);
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) {
-    if (!documents_.count(document_id)) {
-        throw std::out_of_range("No document with this id"s);
-    }
-
-    string_storage_.emplace_back(raw_query);
-    const Query query = ParseQuery(policy, string_storage_.back());
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const {
+    const int internal_id = GetInternalId(document_id);
+    const Query query = ParseQuery(policy, raw_query);
+    const DocumentStatus status = statuses_[internal_id];
     std::vector<std::string_view> matched_words;
 
     bool is_minus_word_in_document = std::any_of(policy, query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_id](std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return false;
-            }
-            if (word_to_document_freqs_.at(word).count(document_id)) {
-                return true;
-            }    
-            return false;
+        [this, status, internal_id](const TermId term_id) {
+            return word_to_document_freqs_[term_id].Contains(status, internal_id);
         });
 
     if (!is_minus_word_in_document) {
-        matched_words.resize(word_to_document_freqs_.size());
+        std::vector<TermId> matched_terms(query.plus_words.size());
         auto it = std::copy_if(policy, query.plus_words.begin(), query.plus_words.end(),
-            matched_words.begin(),
-            [this, &document_id](std::string_view word) {
-                if (word_to_document_freqs_.count(word) == 0) {
-                    return false;
-                }
-                if (word_to_document_freqs_.at(word).count(document_id)) {
-                    return true;
-                }
-                return false;
+            matched_terms.begin(),
+            [this, status, internal_id](const TermId term_id) {
+                return word_to_document_freqs_[term_id].Contains(status, internal_id);
             });
-        matched_words.resize(std::distance(matched_words.begin(), it));
+        matched_terms.erase(it, matched_terms.end());
+
+        std::sort(matched_terms.begin(), matched_terms.end());
+        matched_terms.erase(std::unique(matched_terms.begin(), matched_terms.end()), matched_terms.end());
 
+        matched_words.reserve(matched_terms.size());
+        for (const TermId term_id : matched_terms) {
+            matched_words.push_back(terms_.GetWord(term_id));
+        }
         std::sort(matched_words.begin(), matched_words.end());
-        auto it2 = matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
-        matched_words.resize(std::distance(matched_words.begin(), it2));
     }
 
-    return std::tuple(matched_words, documents_.at(document_id).status);
+    return std::tuple(matched_words, status);
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) {
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
     return MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
-static std::map<std::string_view, double> word_freqs_empty_;
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(std::execution::sequenced_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const {
+    return MatchDocumentsImpl(policy, raw_query, document_ids);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(std::execution::parallel_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const {
+    return MatchDocumentsImpl(policy, raw_query, document_ids);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
+
+template <typename ExecutionPolicy>
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocumentsImpl(ExecutionPolicy& policy, std::string_view raw_query, const std::vector<int>& document_ids) const {
+    std::vector<int> internal_ids(document_ids.size());
+    std::transform(document_ids.begin(), document_ids.end(), internal_ids.begin(), [this](int document_id) {
+        return GetInternalId(document_id);
+    });
+
+    const Query query = ParseQuery(raw_query);
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(document_ids.size());
+    std::transform(policy, internal_ids.begin(), internal_ids.end(), results.begin(),
+        [this, &query](int internal_id) {
+            return std::tuple(MatchDocumentWords(query, internal_id), statuses_[internal_id]);
+        });
+    return results;
+}
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    if (document_to_word_freqs_.count(document_id) == 0) {
-        return word_freqs_empty_;
+// Слова документа в прямом индексе и слова запроса отсортированы по TermId,
+// поэтому пересечение с плюс- и минус-словами ищется слиянием.
+std::vector<std::string_view> SearchServer::MatchDocumentWords(const Query& query, int internal_id) const {
+    const std::vector<TermCount>& word_counts = document_to_word_freqs_[internal_id];
+    const auto less_term = [](const TermCount& word_count, TermId term_id) {
+        return word_count.term_id < term_id;
+    };
+
+    auto word_it = word_counts.begin();
+    for (const TermId term_id : query.minus_words) {
+        word_it = std::lower_bound(word_it, word_counts.end(), term_id, less_term);
+        if (word_it == word_counts.end()) {
+            break;
+        }
+        if (word_it->term_id == term_id) {
+            return {};
+        }
     }
-    else {
-        return document_to_word_freqs_.at(document_id);
+
+    std::vector<std::string_view> matched_words;
+    word_it = word_counts.begin();
+    for (const TermId term_id : query.plus_words) {
+        word_it = std::lower_bound(word_it, word_counts.end(), term_id, less_term);
+        if (word_it == word_counts.end()) {
+            break;
+        }
+        if (word_it->term_id == term_id) {
+            matched_words.push_back(terms_.GetWord(term_id));
+        }
     }
+    std::sort(matched_words.begin(), matched_words.end());
+    return matched_words;
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> word_freqs;
+    const int internal_id = FindInternalId(document_id);
+    if (internal_id == NO_DOCUMENT) {
+        return word_freqs;
+    }
+    const uint32_t word_count = word_counts_[internal_id];
+    for (const auto [term_id, count] : document_to_word_freqs_[internal_id]) {
+        word_freqs.emplace(terms_.GetWord(term_id), ComputeTermFreq(count, word_count));
+    }
+    return word_freqs;
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    SnapshotWriter writer(path);
+    SnapshotHeader header{};
+    std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header.magic);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order_mark = SNAPSHOT_BYTE_ORDER_MARK;
+    header.block_record_size = sizeof(PostingList::Block);
+    header.max_postings_per_block = PostingList::BLOCK_SIZE;
+    writer.WriteBytes(&header, sizeof(header));
+
+    header.stop_words = writer.WriteStringTable(std::vector<std::string_view>(stop_words_.begin(), stop_words_.end()));
+    std::vector<std::string_view> words;
+    words.reserve(terms_.size());
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        words.push_back(terms_.GetWord(term_id));
+    }
+    header.terms = writer.WriteStringTable(words);
+
+    // У каждого слова по записи на статус, отсутствующие списки пишутся пустыми.
+    const PostingList no_postings;
+    std::vector<const PostingList*> posting_lists;
+    posting_lists.reserve(terms_.size() * DOCUMENT_STATUS_COUNT);
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            const PostingList* postings = word_to_document_freqs_[term_id].Find(static_cast<DocumentStatus>(status));
+            posting_lists.push_back(postings ? postings : &no_postings);
+        }
+    }
+    std::vector<SnapshotPostingList> posting_records;
+    posting_records.reserve(posting_lists.size());
+    for (const PostingList* postings : posting_lists) {
+        posting_records.push_back({header.block_count, postings->GetBlocks().size(),
+                                   header.posting_data_size, postings->GetData().size(),
+                                   postings->size(), postings->GetMaxTermFreq()});
+        header.block_count += postings->GetBlocks().size();
+        header.posting_data_size += postings->GetData().size();
+    }
+    header.postings_offset = writer.WriteArray(posting_records.data(), posting_records.size());
+    writer.Align();
+    header.blocks_offset = writer.GetPosition();
+    for (const PostingList* postings : posting_lists) {
+        const ArrayView<PostingList::Block> blocks = postings->GetBlocks();
+        writer.WriteBytes(blocks.data(), blocks.size() * sizeof(PostingList::Block));
+    }
+    header.posting_data_offset = writer.GetPosition();
+    for (const PostingList* postings : posting_lists) {
+        const ArrayView<uint8_t> data = postings->GetData();
+        writer.WriteBytes(data.data(), data.size());
+    }
+
+    std::vector<SnapshotDocument> document_records;
+    std::vector<SnapshotTermCount> term_counts;
+    document_records.reserve(ids_.size());
+    for (const int document_id : ids_) {
+        const int internal_id = internal_ids_.at(document_id);
+        const std::vector<TermCount>& word_counts = document_to_word_freqs_[internal_id];
+        document_records.push_back({document_id, ratings_[internal_id], static_cast<uint32_t>(statuses_[internal_id]),
+                                    word_counts_[internal_id], term_counts.size(), word_counts.size(),
+                                    static_cast<uint64_t>(internal_id)});
+        for (const auto [term_id, count] : word_counts) {
+            term_counts.push_back({term_id, count});
+        }
+    }
+    header.document_count = document_records.size();
+    header.document_slot_count = external_ids_.size();
+    header.documents_offset = writer.WriteArray(document_records.data(), document_records.size());
+    header.term_count_count = term_counts.size();
+    header.term_counts_offset = writer.WriteArray(term_counts.data(), term_counts.size());
+
+    header.file_size = writer.GetPosition();
+    writer.WriteAt(0, &header, sizeof(header));
+    writer.Close();
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+    auto file = std::make_shared<const MappedFile>(path);
+    const SnapshotReader reader(*file);
+    const SnapshotHeader& header = reader.GetHeader();
+    SearchServer server;
+
+    std::set<std::string, std::less<>> stop_words;
+    for (const std::string_view word : reader.ReadStringTable(header.stop_words)) {
+        if (word.empty() || !IsValidWord(word)) {
+            throw std::invalid_argument("Index snapshot contains an invalid stop-word"s);
+        }
+        stop_words.emplace(word);
+    }
+    server.stop_words_ = StopWordSet(stop_words);
+
+    const std::vector<std::string_view> words = reader.ReadStringTable(header.terms);
+    for (TermId term_id = 0; term_id < words.size(); ++term_id) {
+        if (words[term_id].empty() || !IsValidWord(words[term_id])) {
+            throw std::invalid_argument("Index snapshot contains an invalid word"s);
+        }
+        if (server.terms_.Intern(words[term_id]) != term_id) {
+            throw std::invalid_argument("Index snapshot contains duplicate words"s);
+        }
+    }
+
+    if (header.document_slot_count < header.document_count
+        || header.document_slot_count > static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+        throw std::invalid_argument("Index snapshot is corrupted"s);
+    }
+    const size_t slot_count = static_cast<size_t>(header.document_slot_count);
+
+    const auto posting_records = reader.ReadArray<SnapshotPostingList>(header.postings_offset, words.size() * DOCUMENT_STATUS_COUNT);
+    const auto blocks = reader.ReadArray<PostingList::Block>(header.blocks_offset, header.block_count);
+    const auto posting_data = reader.ReadArray<uint8_t>(header.posting_data_offset, header.posting_data_size);
+    uint64_t posting_count = 0;
+    server.word_to_document_freqs_.resize(words.size());
+    for (size_t i = 0; i < posting_records.size(); ++i) {
+        const SnapshotPostingList& record = posting_records[i];
+        if (record.first_block > blocks.size() || record.block_count > blocks.size() - record.first_block
+            || record.data_offset > posting_data.size() || record.data_size > posting_data.size() - record.data_offset) {
+            throw std::invalid_argument("Index snapshot is corrupted"s);
+        }
+        // Номера в постингах индексируют столбцы документов. Внутри списка
+        // они возрастают, так что достаточно проверить последний блок.
+        if (record.block_count > 0
+            && static_cast<size_t>(blocks[record.first_block + record.block_count - 1].last_document_id) >= slot_count) {
+            throw std::invalid_argument("Index snapshot is corrupted"s);
+        }
+        const DocumentStatus status = static_cast<DocumentStatus>(i % DOCUMENT_STATUS_COUNT);
+        if (record.size == 0 && status != DocumentStatus::ACTUAL) {
+            continue;
+        }
+        server.word_to_document_freqs_[i / DOCUMENT_STATUS_COUNT].Get(status) = PostingList(
+            ArrayView<PostingList::Block>(blocks.data() + record.first_block, record.block_count),
+            ArrayView<uint8_t>(posting_data.data() + record.data_offset, record.data_size),
+            record.size, record.max_term_freq);
+        posting_count += record.size;
+    }
+
+    const auto document_records = reader.ReadArray<SnapshotDocument>(header.documents_offset, header.document_count);
+    const auto term_counts = reader.ReadArray<SnapshotTermCount>(header.term_counts_offset, header.term_count_count);
+    if (posting_count != term_counts.size()) {
+        throw std::invalid_argument("Index snapshot is corrupted"s);
+    }
+    server.document_to_word_freqs_.resize(slot_count);
+    server.external_ids_.assign(slot_count, NO_DOCUMENT);
+    server.ratings_.assign(slot_count, 0);
+    server.statuses_.assign(slot_count, DocumentStatus::ACTUAL);
+    server.word_counts_.assign(slot_count, 0);
+    server.internal_ids_.reserve(document_records.size());
+    // Записи документов отсортированы по id, поэтому вставка идёт в конец дерева.
+    for (const SnapshotDocument& record : document_records) {
+        if (record.id < 0 || (!server.ids_.empty() && *server.ids_.rbegin() >= record.id)
+            || record.status > static_cast<uint32_t>(DocumentStatus::REMOVED)
+            || record.internal_id >= slot_count || server.external_ids_[record.internal_id] != NO_DOCUMENT
+            || record.first_term > term_counts.size() || record.term_count > term_counts.size() - record.first_term) {
+            throw std::invalid_argument("Index snapshot is corrupted"s);
+        }
+        std::vector<TermCount> word_counts;
+        word_counts.reserve(record.term_count);
+        for (uint64_t i = record.first_term; i < record.first_term + record.term_count; ++i) {
+            const SnapshotTermCount& term_count = term_counts[i];
+            if (term_count.term_id >= words.size() || (!word_counts.empty() && word_counts.back().term_id >= term_count.term_id)) {
+                throw std::invalid_argument("Index snapshot is corrupted"s);
+            }
+            word_counts.push_back({term_count.term_id, term_count.count});
+        }
+        const int internal_id = static_cast<int>(record.internal_id);
+        server.document_to_word_freqs_[internal_id] = std::move(word_counts);
+        server.external_ids_[internal_id] = record.id;
+        server.ratings_[internal_id] = record.rating;
+        server.statuses_[internal_id] = static_cast<DocumentStatus>(record.status);
+        server.word_counts_[internal_id] = record.word_count;
+        server.internal_ids_.emplace(record.id, internal_id);
+        server.ids_.emplace_hint(server.ids_.end(), record.id);
+    }
+
+    // Поиск читает столбцы по номерам из постингов без проверок, поэтому
+    // каждый постинг должен указывать на живой документ своего статуса
+    // и совпадать с его записью в прямом индексе. Постингов столько же,
+    // сколько записей, так что соответствие взаимно однозначное.
+    for (TermId term_id = 0; term_id < words.size(); ++term_id) {
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            const PostingList* postings = server.word_to_document_freqs_[term_id].Find(static_cast<DocumentStatus>(status));
+            for (size_t block_index = 0; postings && block_index < postings->GetBlocks().size(); ++block_index) {
+                for (const PostingList::Posting& posting : postings->DecodeRawBlock(block_index)) {
+                    const int internal_id = posting.document_id;
+                    if (server.external_ids_[internal_id] == NO_DOCUMENT
+                        || server.statuses_[internal_id] != static_cast<DocumentStatus>(status)
+                        || server.word_counts_[internal_id] != posting.document_length) {
+                        throw std::invalid_argument("Index snapshot is corrupted"s);
+                    }
+                    const std::vector<TermCount>& word_counts = server.document_to_word_freqs_[internal_id];
+                    const auto it = std::lower_bound(word_counts.begin(), word_counts.end(), term_id,
+                        [](const TermCount& term_count, TermId id) {
+                            return term_count.term_id < id;
+                        });
+                    if (it == word_counts.end() || it->term_id != term_id || it->count != posting.term_count) {
+                        throw std::invalid_argument("Index snapshot is corrupted"s);
+                    }
+                }
+            }
+        }
+    }
+
+    server.snapshot_file_ = std::move(file);
+    return server;
+}
+
+// Документы всех источников обходятся по возрастанию id и в том же порядке
+// получают новые номера, поэтому постинги каждого слова копятся уже
+// упорядоченными и дописываются целыми блоками.
+SearchServer SearchServer::Merge(const std::vector<const SearchServer*>& sources, const std::vector<std::set<int>>& removed_ids) {
+    SearchServer server;
+    if (sources.empty()) {
+        return server;
+    }
+    server.stop_words_ = sources.front()->stop_words_;
+
+    std::vector<std::pair<int, size_t>> source_documents;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        for (const int document_id : sources[i]->ids_) {
+            if (removed_ids[i].count(document_id) == 0) {
+                source_documents.emplace_back(document_id, i);
+            }
+        }
+    }
+    std::sort(source_documents.begin(), source_documents.end());
+
+    std::vector<std::array<std::vector<PostingList::Posting>, DOCUMENT_STATUS_COUNT>> term_postings;
+    std::vector<std::vector<TermId>> new_term_ids(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        new_term_ids[i].assign(sources[i]->terms_.size(), TermDictionary::NO_TERM);
+    }
+    for (const auto& [document_id, i] : source_documents) {
+        if (!server.ids_.empty() && *server.ids_.rbegin() == document_id) {
+            throw std::invalid_argument("Document with this id already exists in the database"s);
+        }
+        const SearchServer& source = *sources[i];
+        const int source_internal_id = source.internal_ids_.at(document_id);
+        const int internal_id = server.GetNextInternalId(1);
+        const DocumentStatus status = source.statuses_[source_internal_id];
+        const uint32_t word_count = source.word_counts_[source_internal_id];
+        std::vector<TermCount> word_counts;
+        word_counts.reserve(source.document_to_word_freqs_[source_internal_id].size());
+        for (const auto [term_id, count] : source.document_to_word_freqs_[source_internal_id]) {
+            TermId& new_term_id = new_term_ids[i][term_id];
+            if (new_term_id == TermDictionary::NO_TERM) {
+                new_term_id = server.terms_.Intern(source.terms_.GetWord(term_id));
+            }
+            if (term_postings.size() <= new_term_id) {
+                term_postings.resize(new_term_id + 1);
+            }
+            term_postings[new_term_id][static_cast<size_t>(status)].push_back({internal_id, count, word_count});
+            word_counts.push_back({new_term_id, count});
+        }
+        // Слова источника нумеруются иначе, чем в новом словаре.
+        std::sort(word_counts.begin(), word_counts.end(), [](const TermCount& lhs, const TermCount& rhs) {
+            return lhs.term_id < rhs.term_id;
+        });
+        server.AppendDocument(document_id, source.ratings_[source_internal_id], status, word_count, std::move(word_counts));
+    }
+
+    server.word_to_document_freqs_.resize(server.terms_.size());
+    for (TermId term_id = 0; term_id < server.terms_.size(); ++term_id) {
+        for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+            if (!term_postings[term_id][status].empty()) {
+                server.word_to_document_freqs_[term_id].Get(static_cast<DocumentStatus>(status)).Add(term_postings[term_id][status]);
+            }
+        }
+        server.word_to_document_freqs_[term_id].ShrinkToFit();
+    }
+    return server;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
@@ -140,48 +652,302 @@ void SearchServer::RemoveDocument(int document_id) {
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy, int document_id) {
-    if (!documents_.count(document_id)) {
-        throw std::out_of_range("No document with this id"s);
+    const int internal_id = GetInternalId(document_id);
+    const DocumentStatus status = statuses_[internal_id];
+
+    size_t dead_bytes = 0;
+    for (const auto [term_id, _] : document_to_word_freqs_[internal_id]) {
+        dead_bytes += ErasePosting(term_id, status, internal_id);
     }
 
-    documents_.erase(document_id);
+    EraseDocument(internal_id);
+    ++index_version_;
+    dead_bytes_ += dead_bytes + DOCUMENT_SLOT_SIZE;
+}
+
+void SearchServer::RemoveDocument(std::execution::parallel_policy, int document_id) {
+    const int internal_id = GetInternalId(document_id);
+    const DocumentStatus status = statuses_[internal_id];
+
+    const std::vector<TermCount>& word_counts = document_to_word_freqs_[internal_id];
+
+    const size_t dead_bytes = std::transform_reduce(std::execution::par,
+                    word_counts.begin(), word_counts.end(), size_t{0}, std::plus<>(),
+                    [this, status, internal_id](const TermCount& word_count) {
+                        return ErasePosting(word_count.term_id, status, internal_id);
+                    });
+
+    EraseDocument(internal_id);
+    ++index_version_;
+    dead_bytes_ += dead_bytes + DOCUMENT_SLOT_SIZE;
+}
+
+void SearchServer::RemoveDocuments(std::execution::sequenced_policy policy, const std::vector<int>& document_ids) {
+    RemoveDocumentsImpl(policy, document_ids);
+}
+
+void SearchServer::RemoveDocuments(std::execution::parallel_policy policy, const std::vector<int>& document_ids) {
+    RemoveDocumentsImpl(policy, document_ids);
+}
 
-    for (auto & [word, _] : document_to_word_freqs_[document_id]) {
-        word_to_document_freqs_.at(word).erase(document_id);
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    RemoveDocuments(std::execution::seq, document_ids);
+}
+
+// Пары (слово, документ) сортируются, так что постинги одного слова идут
+// подряд по возрастанию id. Разные постинг-листы независимы и при
+// параллельной политике перекодируются одновременно.
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocumentsImpl(ExecutionPolicy& policy, const std::vector<int>& document_ids) {
+    std::vector<int> removed_ids;
+    removed_ids.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        removed_ids.push_back(GetInternalId(document_id));
     }
+    std::sort(removed_ids.begin(), removed_ids.end());
+    removed_ids.erase(std::unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
 
-    document_to_word_freqs_.erase(document_id);
-    ids_.erase(document_id);
+    std::vector<std::tuple<TermId, DocumentStatus, int>> term_documents;
+    for (const int internal_id : removed_ids) {
+        const DocumentStatus status = statuses_[internal_id];
+        for (const auto& [term_id, _] : document_to_word_freqs_[internal_id]) {
+            term_documents.emplace_back(term_id, status, internal_id);
+        }
+    }
+    std::sort(policy, term_documents.begin(), term_documents.end());
+
+    std::vector<size_t> term_begins;
+    for (size_t i = 0; i < term_documents.size(); ++i) {
+        if (i == 0 || std::get<TermId>(term_documents[i]) != std::get<TermId>(term_documents[i - 1])) {
+            term_begins.push_back(i);
+        }
+    }
+    const size_t dead_bytes = std::transform_reduce(policy,
+        term_begins.begin(), term_begins.end(), size_t{0}, std::plus<>(),
+        [this, &term_documents](size_t begin) {
+            const TermId term_id = std::get<TermId>(term_documents[begin]);
+            std::array<std::vector<int>, DOCUMENT_STATUS_COUNT> term_document_ids;
+            for (size_t i = begin; i < term_documents.size() && std::get<TermId>(term_documents[i]) == term_id; ++i) {
+                const auto [_, status, internal_id] = term_documents[i];
+                term_document_ids[static_cast<size_t>(status)].push_back(internal_id);
+            }
+            return ErasePostings(term_id, term_document_ids);
+        });
+
+    for (const int internal_id : removed_ids) {
+        EraseDocument(internal_id);
+    }
+    ++index_version_;
+    dead_bytes_ += dead_bytes + removed_ids.size() * DOCUMENT_SLOT_SIZE;
 }
 
-void SearchServer::RemoveDocument(std::execution::parallel_policy, int document_id) {
-    if (!documents_.count(document_id)) {
-        throw std::out_of_range("No document with this id"s);
+// Суммы двух независимых 64-битных хешей id слов: от порядка слов
+// в прямом индексе отпечаток не зависит.
+DocumentFingerprint SearchServer::GetDocumentFingerprint(int document_id) const {
+    DocumentFingerprint fingerprint;
+    for (const auto& [term_id, _] : document_to_word_freqs_[GetInternalId(document_id)]) {
+        fingerprint.low += Mix(term_id + 0x9E3779B97F4A7C15ull);
+        fingerprint.high += Mix((static_cast<uint64_t>(term_id) << 32) ^ 0xD6E8FEB86659FD93ull);
+    }
+    return fingerprint;
+}
+
+std::vector<TermId> SearchServer::GetDocumentTerms(int document_id) const {
+    const std::vector<TermCount>& word_counts = document_to_word_freqs_[GetInternalId(document_id)];
+    std::vector<TermId> term_ids;
+    term_ids.reserve(word_counts.size());
+    for (const auto& [term_id, _] : word_counts) {
+        term_ids.push_back(term_id);
     }
+    std::sort(term_ids.begin(), term_ids.end());
+    return term_ids;
+}
 
-    documents_.erase(document_id);
+size_t SearchServer::GetMemoryUsage() const {
+    size_t memory_usage = terms_.GetMemoryUsage()
+                        + (word_to_document_freqs_.capacity() - word_to_document_freqs_.size()) * sizeof(TermPostings);
+    for (const TermPostings& postings : word_to_document_freqs_) {
+        memory_usage += postings.GetMemoryUsage();
+    }
+    memory_usage += document_to_word_freqs_.capacity() * sizeof(std::vector<TermCount>)
+                  + external_ids_.capacity() * sizeof(int) + ratings_.capacity() * sizeof(int)
+                  + statuses_.capacity() * sizeof(DocumentStatus) + word_counts_.capacity() * sizeof(uint32_t);
+    for (const std::vector<TermCount>& word_counts : document_to_word_freqs_) {
+        memory_usage += word_counts.capacity() * sizeof(TermCount);
+    }
+    return memory_usage;
+}
 
-    std::map<std::string_view, double>& word_to_freq_in_document_with_id = document_to_word_freqs_.at(document_id);
-    std::vector<std::string_view> words(word_to_freq_in_document_with_id.size());
+// Живые слова сохраняют относительный порядок, поэтому слова документов
+// в прямом индексе остаются отсортированными по TermId после перенумерации.
+// Живые документы тоже сохраняют порядок номеров, так что постинги
+// перекодируются без сортировки.
+CompactionStats SearchServer::Compact() {
+    const size_t memory_usage = GetMemoryUsage();
 
-    std::transform( std::execution::par, 
-                    word_to_freq_in_document_with_id.begin(), word_to_freq_in_document_with_id.end(),
-                    words.begin(),
-                    [](const std::pair<const std::string_view, double>& ptr_to_word) {
-                        return ptr_to_word.first;
-                    });
+    std::vector<bool> is_live(word_to_document_freqs_.size());
+    size_t live_term_count = 0;
+    for (TermId term_id = 0; term_id < word_to_document_freqs_.size(); ++term_id) {
+        is_live[term_id] = !word_to_document_freqs_[term_id].empty();
+        live_term_count += is_live[term_id];
+    }
+    const std::vector<TermId> new_ids = terms_.Compact(is_live);
 
-    std::for_each(  std::execution::par,
-                    words.begin(), words.end(),
-                    [this, document_id](const std::string_view word) {
-                        word_to_document_freqs_.at(word).erase(document_id);
-                    });
+    std::vector<TermPostings> word_to_document_freqs;
+    word_to_document_freqs.reserve(live_term_count);
+    for (TermId term_id = 0; term_id < word_to_document_freqs_.size(); ++term_id) {
+        if (is_live[term_id]) {
+            word_to_document_freqs.push_back(std::move(word_to_document_freqs_[term_id]));
+            word_to_document_freqs.back().ShrinkToFit();
+        }
+    }
+    word_to_document_freqs_ = std::move(word_to_document_freqs);
 
-    document_to_word_freqs_.erase(document_id);
-    ids_.erase(document_id);
+    for (std::vector<TermCount>& word_counts : document_to_word_freqs_) {
+        for (TermCount& word_count : word_counts) {
+            word_count.term_id = new_ids[word_count.term_id];
+        }
+        word_counts.shrink_to_fit();
+    }
+
+    const size_t removed_document_slots = external_ids_.size() - internal_ids_.size();
+    if (removed_document_slots > 0) {
+        RenumberDocuments();
+    }
+
+    dead_bytes_ = 0;
+    ++index_version_;
+    const size_t new_memory_usage = GetMemoryUsage();
+    return {is_live.size() - live_term_count, removed_document_slots,
+            memory_usage > new_memory_usage ? memory_usage - new_memory_usage : 0};
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+void SearchServer::RenumberDocuments() {
+    std::vector<int> new_ids(external_ids_.size(), NO_DOCUMENT);
+    int next_id = 0;
+    for (size_t internal_id = 0; internal_id < external_ids_.size(); ++internal_id) {
+        if (external_ids_[internal_id] == NO_DOCUMENT) {
+            continue;
+        }
+        const int new_id = next_id++;
+        new_ids[internal_id] = new_id;
+        if (static_cast<size_t>(new_id) == internal_id) {
+            continue;
+        }
+        external_ids_[new_id] = external_ids_[internal_id];
+        ratings_[new_id] = ratings_[internal_id];
+        statuses_[new_id] = statuses_[internal_id];
+        word_counts_[new_id] = word_counts_[internal_id];
+        document_to_word_freqs_[new_id] = std::move(document_to_word_freqs_[internal_id]);
+        internal_ids_[external_ids_[new_id]] = new_id;
+    }
+
+    const size_t document_count = static_cast<size_t>(next_id);
+    external_ids_.resize(document_count);
+    ratings_.resize(document_count);
+    statuses_.resize(document_count);
+    word_counts_.resize(document_count);
+    document_to_word_freqs_.resize(document_count);
+    external_ids_.shrink_to_fit();
+    ratings_.shrink_to_fit();
+    statuses_.shrink_to_fit();
+    word_counts_.shrink_to_fit();
+    document_to_word_freqs_.shrink_to_fit();
+
+    for (TermPostings& postings : word_to_document_freqs_) {
+        postings.RenumberDocuments(new_ids);
+    }
+}
+
+void SearchServer::SetCompactionThreshold(size_t dead_bytes) {
+    compaction_threshold_ = dead_bytes;
+}
+
+std::optional<CompactionStats> SearchServer::CompactIfNeeded() {
+    if (compaction_threshold_ == 0 || dead_bytes_ < compaction_threshold_) {
+        return std::nullopt;
+    }
+    return Compact();
+}
+
+// Возвращает оценку памяти, которая освободится при Compact благодаря
+// удалению постинга: хвост буферов списка и, если список опустел, само слово.
+size_t SearchServer::ErasePosting(TermId term_id, DocumentStatus status, int internal_id) {
+    TermPostings& postings = word_to_document_freqs_[term_id];
+    const size_t unused_capacity = postings.GetUnusedCapacity();
+    postings.Get(status).Erase(internal_id);
+    return CountDeadBytes(term_id, unused_capacity);
+}
+
+size_t SearchServer::ErasePostings(TermId term_id, const std::array<std::vector<int>, DOCUMENT_STATUS_COUNT>& internal_ids) {
+    TermPostings& postings = word_to_document_freqs_[term_id];
+    const size_t unused_capacity = postings.GetUnusedCapacity();
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if (!internal_ids[status].empty()) {
+            postings.Get(static_cast<DocumentStatus>(status)).Erase(internal_ids[status]);
+        }
+    }
+    return CountDeadBytes(term_id, unused_capacity);
+}
+
+size_t SearchServer::CountDeadBytes(TermId term_id, size_t unused_capacity) const {
+    const TermPostings& postings = word_to_document_freqs_[term_id];
+    if (postings.empty()) {
+        return postings.GetMemoryUsage() + sizeof(std::string) + terms_.GetWord(term_id).size();
+    }
+    return std::max(postings.GetUnusedCapacity(), unused_capacity) - unused_capacity;
+}
+
+std::vector<SearchServer::DocumentRange> SearchServer::SplitIntoDocumentRanges(const Query& query, std::optional<DocumentStatus> only_status) const {
+    // Границы диапазонов берутся из самого длинного постинг-листа запроса,
+    // чтобы работа делилась между потоками примерно поровну.
+    static constexpr size_t MIN_POSTINGS_PER_RANGE = 4096;
+
+    const PostingList* longest_postings = nullptr;
+    for (const TermId term_id : query.plus_words) {
+        ForEachPostingList(term_id, only_status, [&longest_postings](const PostingList& postings) {
+            if (!longest_postings || longest_postings->size() < postings.size()) {
+                longest_postings = &postings;
+            }
+        });
+    }
+
+    size_t range_count = 1;
+    if (longest_postings) {
+        const size_t max_range_count = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4;
+        range_count = std::clamp<size_t>(longest_postings->size() / MIN_POSTINGS_PER_RANGE, 1, max_range_count);
+        range_count = std::min(range_count, longest_postings->GetBlocks().size());
+    }
+
+    std::vector<DocumentRange> ranges;
+    ranges.reserve(range_count);
+    int first_document_id = std::numeric_limits<int>::min();
+    for (size_t i = 1; i < range_count; ++i) {
+        const auto& blocks = longest_postings->GetBlocks();
+        const int boundary = blocks[i * blocks.size() / range_count].first_document_id;
+        if (boundary > first_document_id) {
+            ranges.push_back({first_document_id, boundary - 1});
+            first_document_id = boundary;
+        }
+    }
+    ranges.push_back({first_document_id, std::numeric_limits<int>::max()});
+    return ranges;
+}
+
+void SearchServer::SelectTopDocuments(std::vector<Document>& documents) {
+    const auto middle = documents.begin() + std::min(documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    std::partial_sort(documents.begin(), middle, documents.end(),
+        [](const Document& lhs, const Document& rhs) {
+            if (std::abs(lhs.relevance - rhs.relevance) < RESEDUAL_OF_DOCUMENT_RELEVANCE) {
+                return lhs.rating > rhs.rating;
+            } else {
+                return lhs.relevance > rhs.relevance;
+            }
+        });
+    documents.erase(middle, documents.end());
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text, bool check_characters) const {
     if (text.size() == 1 && text[0] == '-') {
         throw std::invalid_argument("Word contains only \"-\" character"s);
     }
@@ -190,7 +956,7 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
         throw std::invalid_argument("Word contains more than one \"-\" character at the beginning"s);
     }
 
-    if (!IsValidWord(text)) {
+    if (check_characters && !IsValidWord(text)) {
         throw std::invalid_argument("Word contains invalid characters"s);
     }
 
@@ -203,20 +969,63 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-    std::vector<std::string_view> words_no_stop;
-    for (const std::string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word contains invalid characters"s);
-        }
-        if (!IsStopWord(word)) {
-            words_no_stop.push_back(word);
-        }
+void SearchServer::CheckNewDocumentId(int document_id) const {
+    if (document_id < 0) {
+        throw std::invalid_argument("Document id less than zero"s);
+    }
+
+    if (internal_ids_.count(document_id) != 0) {
+        throw std::invalid_argument("Document with this id already exists in the database"s);
+    }
+}
+
+int SearchServer::FindInternalId(int document_id) const {
+    const auto it = internal_ids_.find(document_id);
+    return it == internal_ids_.end() ? NO_DOCUMENT : it->second;
+}
+
+int SearchServer::GetInternalId(int document_id) const {
+    const int internal_id = FindInternalId(document_id);
+    if (internal_id == NO_DOCUMENT) {
+        throw std::out_of_range("No document with this id"s);
+    }
+    return internal_id;
+}
+
+int SearchServer::GetNextInternalId(size_t document_count) const {
+    if (document_count > static_cast<size_t>(std::numeric_limits<int>::max()) - external_ids_.size()) {
+        throw std::out_of_range("Internal document ids are exhausted, call Compact"s);
+    }
+    return static_cast<int>(external_ids_.size());
+}
+
+int SearchServer::AppendDocument(int document_id, int rating, DocumentStatus status, uint32_t word_count, std::vector<TermCount> word_counts) {
+    const int internal_id = static_cast<int>(external_ids_.size());
+    external_ids_.push_back(document_id);
+    ratings_.push_back(rating);
+    statuses_.push_back(status);
+    word_counts_.push_back(word_count);
+    document_to_word_freqs_.push_back(std::move(word_counts));
+    internal_ids_.emplace(document_id, internal_id);
+    ids_.insert(document_id);
+    return internal_id;
+}
+
+void SearchServer::EraseDocument(int internal_id) {
+    const int document_id = external_ids_[internal_id];
+    internal_ids_.erase(document_id);
+    ids_.erase(document_id);
+    external_ids_[internal_id] = NO_DOCUMENT;
+    document_to_word_freqs_[internal_id] = {};
+}
+
+void SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+    if (!::SplitIntoWordsNoStop(text, stop_words_, words)) {
+        throw std::invalid_argument("Word contains invalid characters"s);
     }
-    return words_no_stop;
 }
 
 SearchServer::Query SearchServer::ParseQuery(std::execution::sequenced_policy policy, std::string_view text) const {
@@ -232,20 +1041,27 @@ SearchServer::Query SearchServer::ParseQuery(std::execution::sequenced_policy po
 }
 
 SearchServer::Query SearchServer::ParseQuery(std::execution::parallel_policy policy, std::string_view text) const {
-    const std::vector<std::string_view> words = SplitIntoWords(text);
+    thread_local std::vector<std::string_view> words;
+    const bool is_valid_text = SplitIntoWords(text, words);
     SearchServer::Query query_words;
 
     query_words.plus_words.reserve(words.size());
     query_words.minus_words.reserve(words.size());
 
-    std::for_each(words.begin(), words.end(), [&query_words, this](std::string_view word) {
-        const SearchServer::QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query_words.minus_words.push_back(query_word.data);
-            } else {
-                query_words.plus_words.push_back(query_word.data);
-            }
+    std::for_each(words.begin(), words.end(), [&query_words, is_valid_text, this](std::string_view word) {
+        const SearchServer::QueryWord query_word = ParseQueryWord(word, !is_valid_text);
+        if (query_word.is_stop) {
+            return;
+        }
+        // Слова, которых нет ни в одном документе, ничего не находят и ничего не исключают.
+        const TermId term_id = terms_.Find(query_word.data);
+        if (term_id == TermDictionary::NO_TERM) {
+            return;
+        }
+        if (query_word.is_minus) {
+            query_words.minus_words.push_back(term_id);
+        } else {
+            query_words.plus_words.push_back(term_id);
         }
     });
 
@@ -256,8 +1072,8 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
     return ParseQuery(std::execution::seq, text);
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return std::log(SearchServer::GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return word_to_document_freqs_[term_id].GetInverseDocumentFreq(index_version_, GetDocumentCount());
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
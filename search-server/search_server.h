@@ -1,29 +1,73 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <stdexcept>
 #include <utility>
 #include <map>
+#include <unordered_map>
 #include <set>
-#include <deque>
 #include <numeric>
 #include <algorithm>
 #include <iterator>
 #include <execution>
 #include <future>
 #include <type_traits>
+#include <queue>
+#include <functional>
+#include <limits>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <tuple>
+#include <optional>
 
 #include "document.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "mapped_file.h"
+#include "stop_word_set.h"
+#include "query_result_cache.h"
+#include "query_metrics.h"
 
 using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double RESEDUAL_OF_DOCUMENT_RELEVANCE = 1e-6;
 
+struct NewDocument {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
+// 128-битный отпечаток множества слов документа. У документов с одинаковым
+// набором слов отпечатки равны. Сравнивать можно только отпечатки
+// документов одного сервера: слова в них представлены своими id.
+struct DocumentFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const DocumentFingerprint& other) const noexcept {
+        return low == other.low && high == other.high;
+    }
+
+    bool operator<(const DocumentFingerprint& other) const noexcept {
+        return std::tie(high, low) < std::tie(other.high, other.low);
+    }
+};
+
+struct CompactionStats {
+    size_t removed_terms = 0;
+    // Освободившиеся внутренние номера удалённых документов.
+    size_t removed_document_slots = 0;
+    size_t reclaimed_bytes = 0;
+};
+
 class SearchServer {
 public:
     template <typename Container>
@@ -34,6 +78,15 @@ public:
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Добавляет пакет документов. Ошибка в одном документе не мешает
+    // остальным: для каждого документа возвращается исключение, которое
+    // бросил бы AddDocument, или nullptr, если документ добавлен. Из нескольких
+    // документов пакета с одинаковым id добавляется первый без других ошибок,
+    // как при вызовах AddDocument по очереди.
+    std::vector<std::exception_ptr> AddDocuments(std::execution::sequenced_policy policy, const std::vector<NewDocument>& documents);
+    std::vector<std::exception_ptr> AddDocuments(std::execution::parallel_policy policy, const std::vector<NewDocument>& documents);
+    std::vector<std::exception_ptr> AddDocuments(const std::vector<NewDocument>& documents);
+
     template <typename ExecutionPolicy, typename DocumentFilter>
     std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter) const;
     template <typename DocumentFilter>
@@ -42,17 +95,117 @@ public:
     std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status=DocumentStatus::ACTUAL) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status=DocumentStatus::ACTUAL) const;
 
+    // Поиск в части большого корпуса: IDF слова берётся из
+    // inverse_document_freq(word), а не считается по документам этого сервера.
+    template <typename ExecutionPolicy, typename DocumentFilter, typename InverseDocumentFreq>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter, InverseDocumentFreq inverse_document_freq) const;
+    // То же для поиска по статусу: читаются только постинг-листы статуса,
+    // а выдача берётся из кэша, если IDF слов запроса не изменились.
+    template <typename ExecutionPolicy, typename InverseDocumentFreq>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status, InverseDocumentFreq inverse_document_freq) const;
+
+    // Буферы поиска одного потока. Если передавать их в FindTopDocuments,
+    // память под курсоры и кандидатов выделяется один раз на много запросов.
+    class QueryBuffers;
+
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentFilter document_filter, QueryBuffers& buffers) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status, QueryBuffers& buffers) const;
+
+    // Включает кэш результатов поиска по статусу на capacity запросов,
+    // ноль выключает его. Запрос ищется в кэше после разбора, поэтому
+    // запросы, отличающиеся порядком и повторами слов, считаются одним.
+    // Копия сервера получает пустой кэш той же ёмкости.
+    void SetResultCacheCapacity(size_t capacity);
+
+    QueryCacheStats GetResultCacheStats() const {
+        return result_cache_.GetStats();
+    }
+
+    // Оставляет в documents MAX_RESULT_DOCUMENT_COUNT лучших в порядке выдачи.
+    static void SelectTopDocuments(std::vector<Document>& documents);
+
     int GetDocumentCount() const;
 
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id);
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id);
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id);
+    bool HasDocument(int document_id) const;
+
+    // Число документов, в которых встречается word.
+    size_t GetDocumentFreq(std::string_view word) const;
+
+    // Найденные слова ссылаются на строки словаря сервера, а не на raw_query.
+    // Можно вызывать из нескольких потоков одновременно с поиском.
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    // Сопоставляет запрос сразу с несколькими документами: запрос разбирается
+    // один раз, а каждый документ проверяется одним проходом по его словам.
+    // Бросает std::out_of_range, если хотя бы одного документа нет.
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::sequenced_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::parallel_policy policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
 
+    // Словарь при удалении не сжимается, поэтому string_view из MatchDocument
+    // и GetWordFrequencies для остальных документов остаются действительными
+    // до вызова Compact или CompactIfNeeded.
     void RemoveDocument(std::execution::sequenced_policy policy, int document_id);
     void RemoveDocument(std::execution::parallel_policy policy, int document_id);
     void RemoveDocument(int document_id);
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Удаляет сразу много документов: каждый затронутый постинг-лист
+    // перекодируется один раз, а не по разу на документ. Бросает
+    // std::out_of_range, не меняя индекс, если какого-то документа нет.
+    void RemoveDocuments(std::execution::sequenced_policy policy, const std::vector<int>& document_ids);
+    void RemoveDocuments(std::execution::parallel_policy policy, const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Бросает std::out_of_range, если документа нет.
+    DocumentFingerprint GetDocumentFingerprint(int document_id) const;
+
+    // Id слов документа по возрастанию. Бросает std::out_of_range, если
+    // документа нет. Как и отпечатки, сравнимы только в пределах сервера.
+    std::vector<TermId> GetDocumentTerms(int document_id) const;
+
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Оценка памяти, занятой словарём, постинг-листами и прямым индексом.
+    // Отображённый в память снимок не учитывается.
+    size_t GetMemoryUsage() const;
+
+    // Удаляет из словаря слова, которых не осталось ни в одном документе,
+    // перенумеровывает подряд оставшиеся документы и отдаёт лишнюю память
+    // постинг-листов и столбцов документов. Слова перенумеровываются,
+    // поэтому string_view, полученные из MatchDocument и GetWordFrequencies,
+    // становятся недействительными.
+    CompactionStats Compact();
+
+    // Порог для CompactIfNeeded по оценке освободившейся памяти. Ноль
+    // отключает сжатие по порогу.
+    void SetCompactionThreshold(size_t dead_bytes);
+
+    // Вызывает Compact, если оценка освободившейся памяти достигла порога,
+    // и возвращает его статистику, иначе nullopt. Как и Compact, делает
+    // недействительными string_view, полученные из MatchDocument
+    // и GetWordFrequencies, поэтому вызывается только явно, например
+    // периодически между пакетами изменений, а не из RemoveDocument.
+    std::optional<CompactionStats> CompactIfNeeded();
+
+    size_t GetDeadBytes() const noexcept {
+        return dead_bytes_;
+    }
+
+    // Сохраняет всё состояние сервера в двоичный снимок.
+    void SaveSnapshot(const std::string& path) const;
+    // Загружает сервер из снимка. Постинг-листы читаются прямо из отображённого
+    // в память файла, заново строятся только словари и прямой индекс.
+    // Бросает std::runtime_error при ошибке чтения и std::invalid_argument,
+    // если файл повреждён или записан в несовместимом формате.
+    static SearchServer LoadSnapshot(const std::string& path);
+
+    // Собирает новый сервер из документов sources, кроме документов
+    // с id из removed_ids[i] в sources[i]. Стоп-слова берутся из первого
+    // источника. Бросает std::invalid_argument, если id повторяется.
+    static SearchServer Merge(const std::vector<const SearchServer*>& sources, const std::vector<std::set<int>>& removed_ids);
 
     auto begin() noexcept {
         return ids_.begin();
@@ -71,18 +224,41 @@ public:
     }
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    static constexpr int NO_DOCUMENT = -1;
+
+    struct TermCount {
+        TermId term_id;
+        uint32_t count;
     };
 
-    std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    // Память под один номер во всех столбцах, освобождаемая в Compact.
+    static constexpr size_t DOCUMENT_SLOT_SIZE = sizeof(std::vector<TermCount>) + 2 * sizeof(int)
+                                               + sizeof(DocumentStatus) + sizeof(uint32_t);
+
+    StopWordSet stop_words_;
+    TermDictionary terms_;
+    // Постинг-листы и прямой индекс хранят не id документов, а внутренние
+    // номера, которые выдаются подряд в порядке добавления. Свойства
+    // документов лежат по столбцам в массивах с индексом по номеру, так
+    // что фильтр и рейтинг кандидата читаются без поиска в дереве. Номер
+    // удалённого документа не переиспользуется до Compact: в external_ids_
+    // для него NO_DOCUMENT, а список слов пуст.
+    std::vector<TermPostings> word_to_document_freqs_;
+    std::vector<std::vector<TermCount>> document_to_word_freqs_;
+    std::vector<int> external_ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<uint32_t> word_counts_;
+    std::unordered_map<int, int> internal_ids_;
     std::set<int> ids_;
-
-    std::deque<std::string> string_storage_;
+    // Увеличивается при каждом изменении индекса и сбрасывает кэши IDF.
+    uint64_t index_version_ = 0;
+    // Снимок, на который ссылаются постинг-листы после LoadSnapshot.
+    std::shared_ptr<const MappedFile> snapshot_file_;
+    // Оценка памяти, освободившейся после удаления документов с последнего Compact.
+    size_t dead_bytes_ = 0;
+    size_t compaction_threshold_ = 0;
+    mutable QueryResultCache result_cache_;
 
     struct QueryWord {
         std::string_view data;
@@ -90,33 +266,122 @@ private:
         bool is_stop;
     };
     
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // Символы слова проверяются, только если check_characters: обычно
+    // весь запрос уже проверен при разбиении на слова.
+    QueryWord ParseQueryWord(std::string_view text, bool check_characters) const;
 
     bool IsStopWord(std::string_view word) const;
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Бросает std::invalid_argument, если в тексте есть недопустимые символы.
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
+
+    void CheckNewDocumentId(int document_id) const;
+
+    // Внутренний номер документа или NO_DOCUMENT.
+    int FindInternalId(int document_id) const;
+
+    // Бросает std::out_of_range, если документа нет.
+    int GetInternalId(int document_id) const;
+
+    // Номер для первого из document_count новых документов. Бросает
+    // std::out_of_range, если номера не поместятся в int.
+    int GetNextInternalId(size_t document_count) const;
+
+    // Заводит ячейки документа в конце столбцов и возвращает его номер.
+    int AppendDocument(int document_id, int rating, DocumentStatus status, uint32_t word_count, std::vector<TermCount> word_counts);
+
+    // Постинги документа должны быть уже удалены.
+    void EraseDocument(int internal_id);
+
+    // Сдвигает живые документы к началу столбцов и перекодирует постинги.
+    void RenumberDocuments();
+
+    size_t ErasePosting(TermId term_id, DocumentStatus status, int internal_id);
+    // internal_ids[status] — упорядоченные номера удаляемых документов этого статуса.
+    size_t ErasePostings(TermId term_id, const std::array<std::vector<int>, DOCUMENT_STATUS_COUNT>& internal_ids);
+
+    // Сколько памяти освободилось в постинг-листе слова, если до удаления
+    // в нём было unused_capacity байт сверх нужного.
+    size_t CountDeadBytes(TermId term_id, size_t unused_capacity) const;
+
+    template <typename ExecutionPolicy>
+    void RemoveDocumentsImpl(ExecutionPolicy& policy, const std::vector<int>& document_ids);
+
+    template <typename ExecutionPolicy>
+    std::vector<std::exception_ptr> AddDocumentsImpl(ExecutionPolicy& policy, const std::vector<NewDocument>& documents);
 
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        std::vector<TermId> plus_words;
+        std::vector<TermId> minus_words;
+        // IDF плюс-слов; заполняется только для поиска.
+        std::vector<double> inverse_document_freqs;
     };
 
     Query ParseQuery(std::execution::sequenced_policy policy, std::string_view text) const;
     Query ParseQuery(std::execution::parallel_policy policy, std::string_view text) const;
     Query ParseQuery(std::string_view text) const;
 
+    struct DocumentRange {
+        int first_document_id;
+        int last_document_id;
+    };
+
+    std::vector<DocumentRange> SplitIntoDocumentRanges(const Query& query, std::optional<DocumentStatus> only_status) const;
+
+    // Вызывает action для непустых постинг-листов слова, которые читает
+    // поиск: только статуса only_status, если он задан, иначе всех.
+    template <typename Action>
+    void ForEachPostingList(TermId term_id, std::optional<DocumentStatus> only_status, Action action) const;
+
+    std::vector<std::string_view> MatchDocumentWords(const Query& query, int internal_id) const;
+
+    template <typename ExecutionPolicy>
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocumentsImpl(ExecutionPolicy& policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    struct ScoredCursor {
+        PostingCursor cursor;
+        double inverse_document_freq;
+        double max_score;
+    };
+
+    template <typename ExecutionPolicy, typename DocumentFilter, typename InverseDocumentFreq>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter, InverseDocumentFreq inverse_document_freq, QueryBuffers& buffers) const;
+
+    // inverse_document_freq(term_id) даёт IDF слова словаря.
+    template <typename ExecutionPolicy, typename InverseDocumentFreq>
+    std::vector<Document> FindTopDocumentsWithStatus(ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus document_status, InverseDocumentFreq inverse_document_freq, QueryBuffers& buffers) const;
+
+    // query.inverse_document_freqs должны быть заполнены. Если задан
+    // only_status, читаются только постинги документов с этим статусом.
+    template <typename ExecutionPolicy, typename DocumentFilter>
+    std::vector<Document> FindTopDocumentsForQuery(ExecutionPolicy& policy, const Query& query, std::optional<DocumentStatus> only_status, DocumentFilter document_filter, QueryBuffers& buffers) const;
+
+    // Кандидаты в топ складываются в buffers.candidates_.
     template <typename ExecutionPolicy, typename DocumentFilter>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy& policy, const Query& query, DocumentFilter document_filter) const;
+    void FindTopCandidates(ExecutionPolicy& policy, const Query& query, std::optional<DocumentStatus> only_status, DocumentFilter document_filter, QueryBuffers& buffers) const;
     template <typename DocumentFilter>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentFilter document_filter) const;
+    void FindTopCandidates(const Query& query, std::optional<DocumentStatus> only_status, DocumentFilter document_filter, DocumentRange range, std::atomic<double>* shared_threshold, QueryBuffers& buffers) const;
 
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     static bool IsValidWord(std::string_view word);
 };
 
+class SearchServer::QueryBuffers {
+private:
+    friend class SearchServer;
+
+    std::vector<ScoredCursor> plus_cursors_;
+    std::vector<double> max_score_prefix_;
+    std::vector<PostingCursor> minus_cursors_;
+    // Куча с минимумом наверху.
+    std::vector<double> top_relevances_;
+    std::vector<Document> candidates_;
+    QueryTrace trace_;
+};
+
 template <typename Container>
 SearchServer::SearchServer(const Container& stop_words_container) : stop_words_(MakeUniqueNonEmptyStrings(stop_words_container)) {
     if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
@@ -131,102 +396,283 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
 
 template <typename ExecutionPolicy, typename DocumentFilter>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter) const {
-    const Query query = ParseQuery(raw_query);
+    return FindTopDocuments(policy, raw_query, document_filter, [this](std::string_view word) {
+        return ComputeWordInverseDocumentFreq(terms_.Find(word));
+    });
+}
 
-    std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_filter);
+template <typename ExecutionPolicy, typename DocumentFilter, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter, InverseDocumentFreq inverse_document_freq) const {
+    QueryBuffers buffers;
+    return FindTopDocuments(policy, raw_query, document_filter, inverse_document_freq, buffers);
+}
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < RESEDUAL_OF_DOCUMENT_RELEVANCE) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
+template <typename DocumentFilter>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentFilter document_filter, QueryBuffers& buffers) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_filter, [this](std::string_view word) {
+        return ComputeWordInverseDocumentFreq(terms_.Find(word));
+    }, buffers);
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename ExecutionPolicy, typename DocumentFilter, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter, InverseDocumentFreq inverse_document_freq, QueryBuffers& buffers) const {
+    const QueryTraceGuard trace_guard(buffers.trace_);
+    buffers.trace_.Begin(QueryStage::PARSE);
+    Query query = ParseQuery(raw_query);
+    query.inverse_document_freqs.reserve(query.plus_words.size());
+    for (const TermId term_id : query.plus_words) {
+        query.inverse_document_freqs.push_back(inverse_document_freq(terms_.GetWord(term_id)));
     }
-
-    return matched_documents;
+    return FindTopDocumentsForQuery(policy, query, std::nullopt, document_filter, buffers);
 }
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status) const {
-    return FindTopDocuments(policy, raw_query, [&document_status](int document_id, DocumentStatus status, int rating) { return status == document_status; });
+    QueryBuffers buffers;
+    return FindTopDocumentsWithStatus(policy, raw_query, document_status, [this](TermId term_id) {
+        return ComputeWordInverseDocumentFreq(term_id);
+    }, buffers);
+}
+
+template <typename ExecutionPolicy, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status, InverseDocumentFreq inverse_document_freq) const {
+    QueryBuffers buffers;
+    return FindTopDocumentsWithStatus(policy, raw_query, document_status, [this, &inverse_document_freq](TermId term_id) {
+        return inverse_document_freq(terms_.GetWord(term_id));
+    }, buffers);
+}
+
+// Выдача по статусу зависит только от разобранного запроса, статуса,
+// версии индекса и IDF слов, поэтому её можно брать из кэша. Внешняя IDF
+// меняется вместе с остальным корпусом, а версия индекса — нет, так что
+// IDF считаются до поиска в кэше и сверяются с записью. Произвольный
+// фильтр так не описывается, и такие запросы не кэшируются.
+// Постинги читаются только из списков нужного статуса, так что фильтр
+// по документам не нужен.
+template <typename ExecutionPolicy, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocumentsWithStatus(ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus document_status, InverseDocumentFreq inverse_document_freq, QueryBuffers& buffers) const {
+    const QueryTraceGuard trace_guard(buffers.trace_);
+    buffers.trace_.Begin(QueryStage::PARSE);
+    Query query = ParseQuery(raw_query);
+    query.inverse_document_freqs.reserve(query.plus_words.size());
+    for (const TermId term_id : query.plus_words) {
+        query.inverse_document_freqs.push_back(inverse_document_freq(term_id));
+    }
+    std::optional<QueryCacheKey> cache_key;
+    if (result_cache_.IsEnabled()) {
+        cache_key = QueryCacheKey{query.plus_words, query.minus_words, document_status};
+        if (std::optional<std::vector<Document>> documents = result_cache_.Find(*cache_key, index_version_, query.inverse_document_freqs)) {
+            buffers.trace_.Finish();
+            return std::move(*documents);
+        }
+    }
+
+    std::vector<Document> documents = FindTopDocumentsForQuery(policy, query, document_status,
+        [](int document_id, DocumentStatus status, int rating) { return true; }, buffers);
+    if (cache_key) {
+        result_cache_.Insert(std::move(*cache_key), index_version_, query.inverse_document_freqs, documents);
+    }
+    return documents;
 }
 
 template <typename ExecutionPolicy, typename DocumentFilter>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy& policy, const Query& query, DocumentFilter document_filter) const {
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(ExecutionPolicy& policy, const Query& query, std::optional<DocumentStatus> only_status, DocumentFilter document_filter, QueryBuffers& buffers) const {
+    FindTopCandidates(policy, query, only_status, document_filter, buffers);
+    buffers.trace_.Begin(QueryStage::TOP_K);
+    SelectTopDocuments(buffers.candidates_);
+    buffers.trace_.Begin(QueryStage::RESULT_COPY);
+    std::vector<Document> documents = buffers.candidates_;
+    buffers.trace_.Finish();
+    return documents;
+}
+
+// Параллельная версия делит пространство внутренних номеров на непересекающиеся
+// диапазоны. Каждый диапазон обрабатывается независимо со своими курсорами
+// и своим топом, поэтому блокировки не нужны; общий у потоков только
+// атомарный порог отсечения. Итог — объединение топов всех диапазонов.
+template <typename ExecutionPolicy, typename DocumentFilter>
+void SearchServer::FindTopCandidates(ExecutionPolicy& policy, const Query& query, std::optional<DocumentStatus> only_status, DocumentFilter document_filter, QueryBuffers& buffers) const {
     if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
-        std::map<int, double> document_to_relevance;
-        for (const std::string_view& word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
-            }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_filter(document_id,document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
-                }
+        const DocumentRange all_documents{std::numeric_limits<int>::min(), std::numeric_limits<int>::max()};
+        FindTopCandidates(query, only_status, document_filter, all_documents, nullptr, buffers);
+    } else {
+        const std::vector<DocumentRange> ranges = SplitIntoDocumentRanges(query, only_status);
+        std::atomic<double> shared_threshold(-std::numeric_limits<double>::infinity());
+
+        buffers.trace_.Pause();
+        std::vector<QueryBuffers> range_buffers(ranges.size());
+        std::vector<size_t> range_indexes(ranges.size());
+        std::iota(range_indexes.begin(), range_indexes.end(), 0);
+        std::for_each(std::execution::par,
+            range_indexes.begin(), range_indexes.end(),
+            [this, &query, only_status, &document_filter, &shared_threshold, &ranges, &range_buffers](size_t i) {
+                FindTopCandidates(query, only_status, document_filter, ranges[i], &shared_threshold, range_buffers[i]);
+                range_buffers[i].trace_.Begin(QueryStage::TOP_K);
+                SelectTopDocuments(range_buffers[i].candidates_);
+                range_buffers[i].trace_.Pause();
+            });
+
+        std::vector<Document>& candidates = buffers.candidates_;
+        candidates.clear();
+        for (QueryBuffers& range_top : range_buffers) {
+            candidates.insert(candidates.end(), range_top.candidates_.begin(), range_top.candidates_.end());
+            buffers.trace_.Merge(range_top.trace_);
+        }
+    }
+}
+
+// Отбор кандидатов в топ по схеме MaxScore с блочными верхними оценками.
+// Документ пропускается, только если его релевантность заведомо меньше
+// MAX_RESULT_DOCUMENT_COUNT-й лучшей больше чем на RESEDUAL_OF_DOCUMENT_RELEVANCE,
+// то есть он не может попасть в топ даже за счёт рейтинга. Поэтому после
+// сортировки кандидатов результат совпадает с полным перебором.
+// Порог может поступать и от других потоков через shared_threshold: любой
+// чужой топ тоже не хуже итогового, поэтому отсечение остаётся точным.
+// Курсоры идут по внутренним номерам документов, наружу отдаются id.
+// Списки разных статусов одного слова обходятся отдельными курсорами
+// с общей IDF: документ есть только в одном из них, так что сумма
+// вкладов курсоров та же, что и по неразделённому списку.
+template <typename DocumentFilter>
+void SearchServer::FindTopCandidates(const Query& query, std::optional<DocumentStatus> only_status, DocumentFilter document_filter, DocumentRange range, std::atomic<double>* shared_threshold, QueryBuffers& buffers) const {
+    QueryTrace& trace = buffers.trace_;
+    trace.Begin(QueryStage::POSTING_SCAN);
+    std::vector<ScoredCursor>& plus_cursors = buffers.plus_cursors_;
+    plus_cursors.clear();
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const double inverse_document_freq = query.inverse_document_freqs[i];
+        ForEachPostingList(query.plus_words[i], only_status, [&](const PostingList& postings) {
+            plus_cursors.push_back({PostingCursor(postings, inverse_document_freq, range.first_document_id, range.last_document_id),
+                                    inverse_document_freq, postings.GetMaxTermFreq() * inverse_document_freq});
+        });
+    }
+    std::sort(plus_cursors.begin(), plus_cursors.end(),
+        [](const ScoredCursor& lhs, const ScoredCursor& rhs) {
+            return lhs.max_score < rhs.max_score;
+        });
+
+    // max_score_prefix[i] — верхняя оценка вклада слов с 0 по i включительно.
+    std::vector<double>& max_score_prefix = buffers.max_score_prefix_;
+    max_score_prefix.resize(plus_cursors.size());
+    double max_score_sum = 0.0;
+    for (size_t i = 0; i < plus_cursors.size(); ++i) {
+        max_score_sum += plus_cursors[i].max_score;
+        max_score_prefix[i] = max_score_sum;
+    }
+
+    std::vector<PostingCursor>& minus_cursors = buffers.minus_cursors_;
+    minus_cursors.clear();
+    for (const TermId term_id : query.minus_words) {
+        ForEachPostingList(term_id, only_status, [&](const PostingList& postings) {
+            minus_cursors.emplace_back(postings, 0.0, range.first_document_id, range.last_document_id);
+        });
+    }
+
+    std::vector<double>& top_relevances = buffers.top_relevances_;
+    top_relevances.clear();
+    double threshold = -std::numeric_limits<double>::infinity();
+    // Слова до first_essential в сумме не дают порога: документ, который
+    // встречается только в них, в топ не попадёт.
+    size_t first_essential = 0;
+    std::vector<Document>& candidates = buffers.candidates_;
+    candidates.clear();
+
+    const auto update_threshold = [&](double new_threshold) {
+        threshold = std::max(threshold, new_threshold);
+        while (first_essential < plus_cursors.size() && max_score_prefix[first_essential] < threshold) {
+            ++first_essential;
+        }
+    };
+
+    while (true) {
+        if (shared_threshold) {
+            update_threshold(shared_threshold->load(std::memory_order_relaxed));
+        }
+
+        int internal_id = std::numeric_limits<int>::max();
+        bool has_document = false;
+        for (size_t i = first_essential; i < plus_cursors.size(); ++i) {
+            const PostingCursor& cursor = plus_cursors[i].cursor;
+            if (!cursor.IsEnd()) {
+                internal_id = std::min(internal_id, cursor.GetDocumentId());
+                has_document = true;
             }
         }
+        if (!has_document) {
+            break;
+        }
 
-        for (const std::string_view& word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+        double relevance = 0.0;
+        for (size_t i = first_essential; i < plus_cursors.size(); ++i) {
+            PostingCursor& cursor = plus_cursors[i].cursor;
+            if (!cursor.IsEnd() && cursor.GetDocumentId() == internal_id) {
+                relevance += cursor.GetImpact();
+                cursor.Next();
+                trace.AddPostingsScanned(1);
+            }
+        }
+        trace.AddDocumentScored();
+
+        bool is_pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            ScoredCursor& scored = plus_cursors[i];
+            const double rest_max_score = i > 0 ? max_score_prefix[i - 1] : 0.0;
+            const double block_max_score = scored.cursor.GetBlockMaxTermFreq(internal_id) * scored.inverse_document_freq;
+            if (relevance + block_max_score + rest_max_score < threshold) {
+                is_pruned = true;
+                break;
             }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+            scored.cursor.NextGeq(internal_id);
+            if (!scored.cursor.IsEnd() && scored.cursor.GetDocumentId() == internal_id) {
+                relevance += scored.cursor.GetImpact();
+                trace.AddPostingsScanned(1);
             }
         }
-
-        std::vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+        if (is_pruned || relevance < threshold) {
+            continue;
         }
-        return matched_documents;
-    }
-    else {
-        ConcurrentMap<int, double> cm(150);
-        
-        for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-            [&cm, document_filter, this](const auto word) {
-                if (word_to_document_freqs_.count(word) != 0) {
-                    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                    for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                        const auto& document_data = documents_.at(document_id);
-                        if (document_filter(document_id,document_data.status, document_data.rating)) {
-                            cm[document_id].ref_to_value += term_freq * inverse_document_freq;
-                        }
-                    }
-                }
-            });
 
-        for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-            [&cm, document_filter, this](const auto word) {
-                if (word_to_document_freqs_.count(word) != 0) {
-                    for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                        cm.erase(document_id);
-                    }
-                } 
+        trace.Begin(QueryStage::FILTER);
+        const bool is_filtered_out = !document_filter(external_ids_[internal_id], statuses_[internal_id], ratings_[internal_id]);
+        trace.Begin(QueryStage::MINUS_WORDS);
+        const bool is_excluded = is_filtered_out || std::any_of(minus_cursors.begin(), minus_cursors.end(),
+            [internal_id](PostingCursor& cursor) {
+                cursor.NextGeq(internal_id);
+                return !cursor.IsEnd() && cursor.GetDocumentId() == internal_id;
             });
+        trace.Begin(QueryStage::POSTING_SCAN);
+        if (is_excluded) {
+            continue;
+        }
 
-        const std::map<int, double> document_to_relevance = cm.BuildOrdinaryMap();
-        std::vector<Document> matched_documents;
-        matched_documents.reserve(document_to_relevance.size());
-
-        for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+        candidates.push_back({external_ids_[internal_id], relevance, ratings_[internal_id]});
+        top_relevances.push_back(relevance);
+        std::push_heap(top_relevances.begin(), top_relevances.end(), std::greater<double>());
+        if (top_relevances.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            std::pop_heap(top_relevances.begin(), top_relevances.end(), std::greater<double>());
+            top_relevances.pop_back();
+        }
+        if (top_relevances.size() == MAX_RESULT_DOCUMENT_COUNT) {
+            const double local_threshold = top_relevances.front() - RESEDUAL_OF_DOCUMENT_RELEVANCE;
+            update_threshold(local_threshold);
+            if (shared_threshold) {
+                double current = shared_threshold->load(std::memory_order_relaxed);
+                while (current < local_threshold
+                       && !shared_threshold->compare_exchange_weak(current, local_threshold, std::memory_order_relaxed)) {
+                }
+            }
         }
-        return matched_documents;
     }
 }
 
-template <typename DocumentFilter>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentFilter document_filter) const {
-    return FindAllDocuments(std::execution::seq, query, document_filter);
-}
\ No newline at end of file
+template <typename Action>
+void SearchServer::ForEachPostingList(TermId term_id, std::optional<DocumentStatus> only_status, Action action) const {
+    const TermPostings& term_postings = word_to_document_freqs_[term_id];
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if (only_status && static_cast<size_t>(*only_status) != status) {
+            continue;
+        }
+        if (const PostingList* postings = term_postings.Find(static_cast<DocumentStatus>(status))) {
+            action(*postings);
+        }
+    }
+}
@@ -0,0 +1,222 @@
+#include "segmented_search_server.h"
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+SegmentedSearchServer::SegmentedSearchServer(const std::string& stop_words, SegmentMergePolicy policy)
+    : stop_words_(stop_words)
+    , policy_(policy)
+    , write_segment_(stop_words_)
+{
+    if (policy_.max_write_segment_size == 0 || policy_.merge_factor < 2) {
+        throw std::invalid_argument("Invalid segment merge policy"s);
+    }
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    InstallFinishedMerge();
+    if (FindSegment(document_id) != segments_.size()) {
+        throw std::invalid_argument("Document with this id already exists in the database"s);
+    }
+    write_segment_.AddDocument(document_id, document, status, ratings);
+    if (static_cast<size_t>(write_segment_.GetDocumentCount()) >= policy_.max_write_segment_size) {
+        Flush();
+    }
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    InstallFinishedMerge();
+    if (write_segment_.HasDocument(document_id)) {
+        write_segment_.RemoveDocument(document_id);
+        return;
+    }
+    const size_t segment_index = FindSegment(document_id);
+    if (segment_index == segments_.size()) {
+        throw std::out_of_range("No document with this id"s);
+    }
+    segments_[segment_index].Remove(document_id);
+    ScheduleMerge();
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_status);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SegmentedSearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
+    if (write_segment_.HasDocument(document_id)) {
+        return write_segment_.MatchDocument(raw_query, document_id);
+    }
+    const size_t segment_index = FindSegment(document_id);
+    if (segment_index == segments_.size()) {
+        throw std::out_of_range("No document with this id"s);
+    }
+    return segments_[segment_index].index->MatchDocument(raw_query, document_id);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    int document_count = write_segment_.GetDocumentCount();
+    for (const Segment& segment : segments_) {
+        document_count += segment.GetDocumentCount();
+    }
+    return document_count;
+}
+
+void SegmentedSearchServer::Flush() {
+    InstallFinishedMerge();
+    if (write_segment_.GetDocumentCount() == 0) {
+        return;
+    }
+    write_segment_.Compact();
+    segments_.push_back({std::make_shared<const SearchServer>(std::move(write_segment_)), {}, {}});
+    write_segment_ = SearchServer(stop_words_);
+    ScheduleMerge();
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+    while (pending_merge_) {
+        InstallMerge();
+    }
+}
+
+void SegmentedSearchServer::Segment::Remove(int document_id) {
+    removed_ids.insert(document_id);
+    for (const auto& [word, _] : index->GetWordFrequencies(document_id)) {
+        auto it = removed_document_freqs.find(word);
+        if (it == removed_document_freqs.end()) {
+            it = removed_document_freqs.emplace(std::string(word), 0).first;
+        }
+        ++it->second;
+    }
+}
+
+size_t SegmentedSearchServer::FindSegment(int document_id) const {
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (segments_[i].index->HasDocument(document_id) && segments_[i].removed_ids.count(document_id) == 0) {
+            return i;
+        }
+    }
+    return segments_.size();
+}
+
+// Частота слова в корпусе складывается из частот во всех сегментах
+// за вычетом удалённых, но ещё не вычищенных документов.
+std::map<std::string_view, double> SegmentedSearchServer::ComputeInverseDocumentFreqs(std::string_view raw_query) const {
+    const double document_count = GetDocumentCount();
+    std::map<std::string_view, double> inverse_document_freqs;
+    for (std::string_view word : SplitIntoWords(raw_query)) {
+        if (!word.empty() && word[0] == '-') {
+            word.remove_prefix(1);
+        }
+        if (inverse_document_freqs.count(word) != 0) {
+            continue;
+        }
+        size_t document_freq = write_segment_.GetDocumentFreq(word);
+        for (const Segment& segment : segments_) {
+            document_freq += segment.index->GetDocumentFreq(word);
+            const auto it = segment.removed_document_freqs.find(word);
+            if (it != segment.removed_document_freqs.end()) {
+                document_freq -= it->second;
+            }
+        }
+        inverse_document_freqs.emplace(word, document_freq == 0 ? 0.0 : std::log(document_count / document_freq));
+    }
+    return inverse_document_freqs;
+}
+
+// Уровень сегмента — целая часть логарифма числа его документов по
+// основанию merge_factor. Как только где-то подряд набирается merge_factor
+// сегментов одного уровня, они сливаются в один сегмент следующего уровня.
+// Обычно такая серия копится в хвосте, но пока идёт слияние, в хвост
+// успевают дописаться новые сегменты, и серия оказывается в середине.
+// Сегмент, в котором удалена больше чем половина документов, переписывается
+// отдельно, чтобы вычистить удалённые постинги.
+void SegmentedSearchServer::ScheduleMerge() {
+    if (pending_merge_) {
+        return;
+    }
+
+    const auto level = [this](const Segment& segment) {
+        const double document_count = std::max(segment.GetDocumentCount(), 1);
+        return static_cast<int>(std::log(document_count) / std::log(static_cast<double>(policy_.merge_factor)));
+    };
+
+    size_t first = segments_.size();
+    size_t last = segments_.size();
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (segments_[i].removed_ids.size() * 2 > static_cast<size_t>(segments_[i].index->GetDocumentCount())) {
+            first = i;
+            last = i + 1;
+            break;
+        }
+    }
+    for (size_t run_end = segments_.size(); first == segments_.size() && run_end > 0;) {
+        const int run_level = level(segments_[run_end - 1]);
+        size_t run_begin = run_end - 1;
+        while (run_begin > 0 && level(segments_[run_begin - 1]) == run_level) {
+            --run_begin;
+        }
+        if (run_end - run_begin >= policy_.merge_factor) {
+            first = run_end - policy_.merge_factor;
+            last = run_end;
+        }
+        run_end = run_begin;
+    }
+    if (first == last) {
+        return;
+    }
+
+    PendingMerge merge;
+    for (size_t i = first; i < last; ++i) {
+        merge.inputs.push_back(segments_[i].index);
+        merge.removed_ids.push_back(segments_[i].removed_ids);
+    }
+    const auto launch = policy_.merge_in_background ? std::launch::async : std::launch::deferred;
+    merge.result = std::async(launch, [inputs = merge.inputs, removed_ids = merge.removed_ids] {
+        std::vector<const SearchServer*> sources;
+        for (const auto& input : inputs) {
+            sources.push_back(input.get());
+        }
+        return SearchServer::Merge(sources, removed_ids);
+    });
+    pending_merge_ = std::move(merge);
+    if (!policy_.merge_in_background) {
+        WaitForMerges();
+    }
+}
+
+// Пока шло слияние, в его исходных сегментах могли удалить ещё документы;
+// в новом сегменте они сразу помечаются удалёнными.
+void SegmentedSearchServer::InstallMerge() {
+    PendingMerge merge = std::move(*pending_merge_);
+    pending_merge_.reset();
+
+    Segment merged{std::make_shared<const SearchServer>(merge.result.get()), {}, {}};
+    const auto first = std::find_if(segments_.begin(), segments_.end(), [&merge](const Segment& segment) {
+        return segment.index == merge.inputs.front();
+    });
+    for (size_t i = 0; i < merge.inputs.size(); ++i) {
+        for (const int document_id : first[i].removed_ids) {
+            if (merge.removed_ids[i].count(document_id) == 0) {
+                merged.Remove(document_id);
+            }
+        }
+    }
+    const auto last = first + merge.inputs.size();
+    if (merged.GetDocumentCount() == 0) {
+        segments_.erase(first, last);
+    } else {
+        *first = std::move(merged);
+        segments_.erase(first + 1, last);
+    }
+
+    ScheduleMerge();
+}
+
+void SegmentedSearchServer::InstallFinishedMerge() {
+    if (pending_merge_ && policy_.merge_in_background
+        && pending_merge_->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        InstallMerge();
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <future>
+#include <optional>
+#include <tuple>
+#include <cmath>
+#include <execution>
+#include <type_traits>
+#include <algorithm>
+
+#include "document.h"
+#include "search_server.h"
+#include "string_processing.h"
+
+struct SegmentMergePolicy {
+    // Сколько документов копится в изменяемом сегменте до его запечатывания.
+    size_t max_write_segment_size = 4096;
+    // Сколько соседних сегментов одного уровня сливаются в один.
+    size_t merge_factor = 8;
+    // Сливать ли сегменты в фоновом потоке или сразу в вызывающем.
+    bool merge_in_background = true;
+};
+
+// Индекс в духе LSM-дерева. Новые документы попадают в небольшой изменяемый
+// сегмент; заполненный сегмент сжимается и становится неизменяемым.
+// Удаление документа из неизменяемого сегмента только помечает его, а сами
+// постинги вычищаются при слиянии. Сегменты одного уровня (размеры которых
+// отличаются меньше чем в merge_factor раз) сливаются по merge_factor штук,
+// так что сегментов остаётся O(log N). Поиск идёт по всем сегментам с IDF,
+// посчитанной по всему корпусу без удалённых документов, поэтому выдача
+// совпадает с выдачей одного SearchServer с теми же документами.
+class SegmentedSearchServer {
+public:
+    explicit SegmentedSearchServer(const std::string& stop_words, SegmentMergePolicy policy = {});
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    template <typename ExecutionPolicy, typename DocumentFilter>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter) const;
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentFilter document_filter) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status=DocumentStatus::ACTUAL) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status=DocumentStatus::ACTUAL) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    // Число сегментов вместе с изменяемым.
+    size_t GetSegmentCount() const noexcept {
+        return segments_.size() + 1;
+    }
+
+    // Запечатывает изменяемый сегмент, даже если он не заполнен.
+    void Flush();
+
+    // Дожидается всех слияний, которых требует политика.
+    void WaitForMerges();
+
+private:
+    struct Segment {
+        std::shared_ptr<const SearchServer> index;
+        std::set<int> removed_ids;
+        // Сколько удалённых документов содержат слово.
+        std::map<std::string, size_t, std::less<>> removed_document_freqs;
+
+        int GetDocumentCount() const {
+            return index->GetDocumentCount() - static_cast<int>(removed_ids.size());
+        }
+
+        void Remove(int document_id);
+    };
+
+    struct PendingMerge {
+        std::vector<std::shared_ptr<const SearchServer>> inputs;
+        std::vector<std::set<int>> removed_ids;
+        std::future<SearchServer> result;
+    };
+
+    std::string stop_words_;
+    SegmentMergePolicy policy_;
+    SearchServer write_segment_;
+    std::vector<Segment> segments_;
+    std::optional<PendingMerge> pending_merge_;
+
+    // Индекс неизменяемого сегмента с живым документом или segments_.size().
+    size_t FindSegment(int document_id) const;
+
+    std::map<std::string_view, double> ComputeInverseDocumentFreqs(std::string_view raw_query) const;
+
+    void ScheduleMerge();
+
+    void InstallMerge();
+
+    void InstallFinishedMerge();
+};
+
+template <typename DocumentFilter>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentFilter document_filter) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_filter);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status) const {
+    return FindTopDocuments(policy, raw_query, [&document_status](int document_id, DocumentStatus status, int rating) { return status == document_status; });
+}
+
+// Изменяемый сегмент ищется первым в вызывающем потоке: заодно он проверяет
+// запрос, и исключение не вылетает из параллельного алгоритма.
+template <typename ExecutionPolicy, typename DocumentFilter>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter) const {
+    const std::map<std::string_view, double> inverse_document_freqs = ComputeInverseDocumentFreqs(raw_query);
+    const auto inverse_document_freq = [&inverse_document_freqs](std::string_view word) {
+        return inverse_document_freqs.at(word);
+    };
+
+    std::vector<Document> documents = write_segment_.FindTopDocuments(std::execution::seq, raw_query, document_filter, inverse_document_freq);
+
+    std::vector<std::vector<Document>> segment_documents(segments_.size());
+    std::transform(policy, segments_.begin(), segments_.end(), segment_documents.begin(),
+        [&](const Segment& segment) {
+            return segment.index->FindTopDocuments(std::execution::seq, raw_query,
+                [&segment, &document_filter](int document_id, DocumentStatus status, int rating) {
+                    return segment.removed_ids.count(document_id) == 0 && document_filter(document_id, status, rating);
+                },
+                inverse_document_freq);
+        });
+    for (const std::vector<Document>& segment_top : segment_documents) {
+        documents.insert(documents.end(), segment_top.begin(), segment_top.end());
+    }
+    SearchServer::SelectTopDocuments(documents);
+    return documents;
+}
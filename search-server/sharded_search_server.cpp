@@ -0,0 +1,126 @@
+#include "sharded_search_server.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "string_processing.h"
+
+using namespace std::string_literals;
+
+ShardedSearchServer::ShardedSearchServer(const std::string& stop_words, size_t shard_count)
+    : shard_indexes_(shard_count)
+{
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words);
+    }
+    std::iota(shard_indexes_.begin(), shard_indexes_.end(), 0);
+}
+
+void ShardedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    shards_[GetShardIndex(document_id)].AddDocument(document_id, document, status, ratings);
+}
+
+std::vector<std::exception_ptr> ShardedSearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    std::vector<std::vector<NewDocument>> shard_documents(shards_.size());
+    std::vector<std::vector<size_t>> positions(shards_.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const size_t shard_index = GetShardIndex(documents[i].id);
+        shard_documents[shard_index].push_back(documents[i]);
+        positions[shard_index].push_back(i);
+    }
+
+    std::vector<std::exception_ptr> errors(documents.size());
+    std::for_each(std::execution::par, shard_indexes_.begin(), shard_indexes_.end(), [&](size_t shard_index) {
+        const std::vector<std::exception_ptr> shard_errors = shards_[shard_index].AddDocuments(shard_documents[shard_index]);
+        for (size_t i = 0; i < shard_errors.size(); ++i) {
+            errors[positions[shard_index][i]] = shard_errors[i];
+        }
+    });
+    return errors;
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_status);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> ShardedSearchServer::MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const {
+    std::vector<std::vector<int>> shard_document_ids(shards_.size());
+    std::vector<std::vector<size_t>> positions(shards_.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const size_t shard_index = GetShardIndex(document_ids[i]);
+        shard_document_ids[shard_index].push_back(document_ids[i]);
+        positions[shard_index].push_back(i);
+    }
+
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(document_ids.size());
+    ForEachShard([&](size_t shard_index) {
+        auto shard_results = shards_[shard_index].MatchDocuments(raw_query, shard_document_ids[shard_index]);
+        for (size_t i = 0; i < shard_results.size(); ++i) {
+            results[positions[shard_index][i]] = std::move(shard_results[i]);
+        }
+    });
+    return results;
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const SearchServer& shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+void ShardedSearchServer::SetResultCacheCapacity(size_t capacity_per_shard) {
+    for (SearchServer& shard : shards_) {
+        shard.SetResultCacheCapacity(capacity_per_shard);
+    }
+}
+
+QueryCacheStats ShardedSearchServer::GetResultCacheStats() const {
+    QueryCacheStats stats;
+    for (const SearchServer& shard : shards_) {
+        const QueryCacheStats shard_stats = shard.GetResultCacheStats();
+        stats.hit_count += shard_stats.hit_count;
+        stats.miss_count += shard_stats.miss_count;
+        stats.entry_count += shard_stats.entry_count;
+    }
+    return stats;
+}
+
+// Фибоначчиево хеширование: идущие подряд или с общим шагом id всё равно
+// распределяются по шардам равномерно.
+size_t ShardedSearchServer::GetShardIndex(int document_id) const noexcept {
+    const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>((hash >> 32) % shards_.size());
+}
+
+std::map<std::string_view, double> ShardedSearchServer::ComputeInverseDocumentFreqs(std::string_view raw_query) const {
+    const double document_count = GetDocumentCount();
+    std::map<std::string_view, double> inverse_document_freqs;
+    for (std::string_view word : SplitIntoWords(raw_query)) {
+        if (!word.empty() && word[0] == '-') {
+            word.remove_prefix(1);
+        }
+        if (inverse_document_freqs.count(word) != 0) {
+            continue;
+        }
+        size_t document_freq = 0;
+        for (const SearchServer& shard : shards_) {
+            document_freq += shard.GetDocumentFreq(word);
+        }
+        inverse_document_freqs.emplace(word, document_freq == 0 ? 0.0 : std::log(document_count / document_freq));
+    }
+    return inverse_document_freqs;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <exception>
+#include <execution>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+#include "document.h"
+#include "search_server.h"
+
+// Индекс, разбитый на shard_count независимых SearchServer. Документ
+// попадает в шард по хешу своего id. Запрос выполняется на всех шардах
+// сразу, причём IDF считается по частотам слов во всём корпусе, поэтому
+// релевантности совпадают с выдачей одного SearchServer, а итоговый топ
+// собирается из топов шардов. Поиск по статусу идёт в шардах тоже по статусу,
+// так что читает только постинг-листы этого статуса и пользуется кэшем
+// результатов шардов.
+class ShardedSearchServer {
+public:
+    ShardedSearchServer(const std::string& stop_words, size_t shard_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Пакет раскладывается по шардам, и шарды пополняются параллельно.
+    // Ошибки возвращаются так же, как в SearchServer::AddDocuments.
+    std::vector<std::exception_ptr> AddDocuments(const std::vector<NewDocument>& documents);
+
+    void RemoveDocument(int document_id);
+
+    template <typename ExecutionPolicy, typename DocumentFilter>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter) const;
+    template <typename DocumentFilter>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentFilter document_filter) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status=DocumentStatus::ACTUAL) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentStatus& document_status=DocumentStatus::ACTUAL) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    // Документы группируются по шардам, и шарды сопоставляются параллельно.
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    int GetDocumentCount() const;
+
+    // Включает кэш результатов поиска по статусу в каждом шарде.
+    // Записи шарда сверяются с IDF всего корпуса, поэтому изменения
+    // в других шардах не дают устаревшей выдачи.
+    void SetResultCacheCapacity(size_t capacity_per_shard);
+
+    // Сумма статистик кэшей шардов.
+    QueryCacheStats GetResultCacheStats() const;
+
+    size_t GetShardCount() const noexcept {
+        return shards_.size();
+    }
+
+    const SearchServer& GetShard(size_t shard_index) const {
+        return shards_.at(shard_index);
+    }
+
+private:
+    std::vector<SearchServer> shards_;
+    std::vector<size_t> shard_indexes_;
+
+    size_t GetShardIndex(int document_id) const noexcept;
+
+    std::map<std::string_view, double> ComputeInverseDocumentFreqs(std::string_view raw_query) const;
+
+    // Вызывает find_in_shard(shard, inverse_document_freq) для всех шардов
+    // согласно policy с IDF по всему корпусу и собирает общий топ.
+    template <typename ExecutionPolicy, typename FindInShard>
+    std::vector<Document> FindTopDocumentsInShards(ExecutionPolicy& policy, std::string_view raw_query, FindInShard find_in_shard) const;
+
+    // Выполняет action(shard_index) для всех шардов параллельно и бросает
+    // первое из исключений, брошенных внутри.
+    template <typename Action>
+    void ForEachShard(Action action) const;
+};
+
+template <typename DocumentFilter>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentFilter document_filter) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_filter);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentStatus& document_status) const {
+    return FindTopDocumentsInShards(policy, raw_query, [&](const SearchServer& shard, const auto& inverse_document_freq) {
+        return shard.FindTopDocuments(std::execution::seq, raw_query, document_status, inverse_document_freq);
+    });
+}
+
+template <typename ExecutionPolicy, typename DocumentFilter>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentFilter document_filter) const {
+    return FindTopDocumentsInShards(policy, raw_query, [&](const SearchServer& shard, const auto& inverse_document_freq) {
+        return shard.FindTopDocuments(std::execution::seq, raw_query, document_filter, inverse_document_freq);
+    });
+}
+
+template <typename ExecutionPolicy, typename FindInShard>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsInShards(ExecutionPolicy& policy, std::string_view raw_query, FindInShard find_in_shard) const {
+    const std::map<std::string_view, double> inverse_document_freqs = ComputeInverseDocumentFreqs(raw_query);
+    const auto inverse_document_freq = [&inverse_document_freqs](std::string_view word) {
+        return inverse_document_freqs.at(word);
+    };
+
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    const auto find_in_shard_index = [&](size_t shard_index) {
+        shard_documents[shard_index] = find_in_shard(shards_[shard_index], inverse_document_freq);
+    };
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        std::for_each(shard_indexes_.begin(), shard_indexes_.end(), find_in_shard_index);
+    } else {
+        ForEachShard(find_in_shard_index);
+    }
+
+    std::vector<Document> documents;
+    documents.reserve(shards_.size() * MAX_RESULT_DOCUMENT_COUNT);
+    for (const std::vector<Document>& shard_top : shard_documents) {
+        documents.insert(documents.end(), shard_top.begin(), shard_top.end());
+    }
+    SearchServer::SelectTopDocuments(documents);
+    return documents;
+}
+
+template <typename Action>
+void ShardedSearchServer::ForEachShard(Action action) const {
+    std::vector<std::exception_ptr> errors(shards_.size());
+    std::for_each(std::execution::par, shard_indexes_.begin(), shard_indexes_.end(), [&](size_t shard_index) {
+        try {
+            action(shard_index);
+        } catch (...) {
+            errors[shard_index] = std::current_exception();
+        }
+    });
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
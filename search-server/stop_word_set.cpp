@@ -0,0 +1,99 @@
+#include "stop_word_set.h"
+#include "hash_utils.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Сколько смещений пробуется для корзины, прежде чем сменить затравку хеша.
+constexpr uint32_t MAX_DISPLACEMENT = 1u << 12;
+
+} // namespace
+
+StopWordSet::StopWordSet(const std::set<std::string, std::less<>>& words)
+    : words_(words.begin(), words.end())
+{
+    if (words_.empty()) {
+        return;
+    }
+    for (const std::string& word : words_) {
+        max_word_size_ = std::max(max_word_size_, word.size());
+    }
+    // Ячеек вдвое больше, чем слов, и по корзине на два слова.
+    size_t slot_count = 2;
+    while (slot_count < words_.size() * 2) {
+        slot_count *= 2;
+    }
+    slots_.resize(slot_count);
+    displacements_.resize((words_.size() + 1) / 2);
+    while (!TryBuild()) {
+        ++seed_;
+    }
+}
+
+bool StopWordSet::Contains(std::string_view word) const noexcept {
+    if (word.size() > max_word_size_ || words_.empty()) {
+        return false;
+    }
+    const uint64_t hash = Hash(word);
+    const uint32_t word_index = slots_[GetSlot(hash, displacements_[hash % displacements_.size()])];
+    return word_index != NO_WORD && words_[word_index] == word;
+}
+
+// FNV-1a с затравкой.
+uint64_t StopWordSet::Hash(std::string_view word) const noexcept {
+    uint64_t hash = 0xCBF29CE484222325ull ^ Mix(seed_ + 1);
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+    }
+    return Mix(hash);
+}
+
+size_t StopWordSet::GetSlot(uint64_t hash, uint32_t displacement) const noexcept {
+    return Mix((hash >> 32) ^ (hash << 32) ^ (displacement * 0x9E3779B97F4A7C15ull)) & (slots_.size() - 1);
+}
+
+// Корзины заполняются от самых больших к самым маленьким: большим труднее
+// найти смещение, пока свободных ячеек много.
+bool StopWordSet::TryBuild() {
+    std::vector<uint64_t> hashes(words_.size());
+    std::vector<std::vector<uint32_t>> buckets(displacements_.size());
+    for (uint32_t i = 0; i < words_.size(); ++i) {
+        hashes[i] = Hash(words_[i]);
+        buckets[hashes[i] % buckets.size()].push_back(i);
+    }
+    std::vector<size_t> bucket_order(buckets.size());
+    std::iota(bucket_order.begin(), bucket_order.end(), 0);
+    std::stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    std::fill(slots_.begin(), slots_.end(), NO_WORD);
+    std::vector<size_t> bucket_slots;
+    for (const size_t bucket : bucket_order) {
+        bool is_placed = false;
+        for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !is_placed; ++displacement) {
+            bucket_slots.clear();
+            is_placed = true;
+            for (const uint32_t word_index : buckets[bucket]) {
+                const size_t slot = GetSlot(hashes[word_index], displacement);
+                if (slots_[slot] != NO_WORD || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+                    is_placed = false;
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (is_placed) {
+                displacements_[bucket] = displacement;
+                for (size_t i = 0; i < bucket_slots.size(); ++i) {
+                    slots_[bucket_slots[i]] = buckets[bucket][i];
+                }
+            }
+        }
+        if (!is_placed) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Неизменяемое множество стоп-слов с совершенным хешированием: у каждого
+// слова своя ячейка таблицы, поэтому проверка слова — одно хеширование
+// и не больше одного сравнения строк. Ячейка слова выбирается по схеме
+// «хеширование со смещением»: слова делятся на корзины, и для каждой
+// корзины подбирается своё смещение, при котором её слова попадают
+// в свободные ячейки.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+    explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+    bool Contains(std::string_view word) const noexcept;
+
+    size_t size() const noexcept {
+        return words_.size();
+    }
+
+    bool empty() const noexcept {
+        return words_.empty();
+    }
+
+    // Слова в лексикографическом порядке.
+    auto begin() const noexcept {
+        return words_.begin();
+    }
+
+    auto end() const noexcept {
+        return words_.end();
+    }
+
+private:
+    static constexpr uint32_t NO_WORD = UINT32_MAX;
+
+    std::vector<std::string> words_;
+    std::vector<uint32_t> displacements_;
+    // Номер слова в words_ для каждой ячейки или NO_WORD.
+    std::vector<uint32_t> slots_;
+    uint64_t seed_ = 0;
+    size_t max_word_size_ = 0;
+
+    uint64_t Hash(std::string_view word) const noexcept;
+
+    size_t GetSlot(uint64_t hash, uint32_t displacement) const noexcept;
+
+    bool TryBuild();
+};
@@ -1,18 +1,86 @@
 #include "string_processing.h"
 
-std::vector<std::string_view> SplitIntoWords(std::string_view text) {
-    std::vector<std::string_view> words;
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
 
-    while(true) {
-        size_t space = text.find(' ');
-        words.push_back(text.substr(0, space));
-        if(space == text.npos) {
-            break;
+// Один проход по тексту: вызывает on_word для каждого слова между пробелами,
+// включая пустые, и заодно ищет управляющие символы (коды от 0 до 31).
+// Пробелы и управляющие символы ищутся сразу в блоках по 32 или 16 байт,
+// хвост короче блока досматривается побайтно. Возвращает false, если
+// управляющие символы нашлись.
+template <typename OnWord>
+bool ScanWords(std::string_view text, OnWord on_word) {
+    const char* const data = text.data();
+    const size_t size = text.size();
+    size_t word_begin = 0;
+    size_t pos = 0;
+    bool has_control = false;
+
+    const auto emit_words = [&](size_t block_begin, uint32_t space_mask) {
+        while (space_mask != 0) {
+            const size_t space = block_begin + static_cast<size_t>(__builtin_ctz(space_mask));
+            on_word(text.substr(word_begin, space - word_begin));
+            word_begin = space + 1;
+            space_mask &= space_mask - 1;
         }
-        else {
-            text.remove_prefix(space + 1);
+    };
+
+#if defined(__AVX2__)
+    for (; pos + 32 <= size; pos += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const __m256i spaces = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+        const __m256i controls = _mm256_cmpeq_epi8(_mm256_and_si256(block, _mm256_set1_epi8(static_cast<char>(0xE0))), _mm256_setzero_si256());
+        has_control |= _mm256_movemask_epi8(controls) != 0;
+        emit_words(pos, static_cast<uint32_t>(_mm256_movemask_epi8(spaces)));
+    }
+#endif
+#if defined(__SSE2__)
+    for (; pos + 16 <= size; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const __m128i spaces = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+        const __m128i controls = _mm_cmpeq_epi8(_mm_and_si128(block, _mm_set1_epi8(static_cast<char>(0xE0))), _mm_setzero_si128());
+        has_control |= _mm_movemask_epi8(controls) != 0;
+        emit_words(pos, static_cast<uint32_t>(_mm_movemask_epi8(spaces)));
+    }
+#endif
+    for (; pos < size; ++pos) {
+        const unsigned char c = static_cast<unsigned char>(data[pos]);
+        has_control |= c < ' ';
+        if (c == ' ') {
+            on_word(text.substr(word_begin, pos - word_begin));
+            word_begin = pos + 1;
         }
     }
+    on_word(text.substr(word_begin));
 
+    return !has_control;
+}
+
+} // namespace
+
+std::vector<std::string_view> SplitIntoWords(std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
     return words;
-}
\ No newline at end of file
+}
+
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    return ScanWords(text, [&words](std::string_view word) {
+        words.push_back(word);
+    });
+}
+
+bool SplitIntoWordsNoStop(std::string_view text, const StopWordSet& stop_words, std::vector<std::string_view>& words) {
+    words.clear();
+    return ScanWords(text, [&words, &stop_words](std::string_view word) {
+        if (!stop_words.Contains(word)) {
+            words.push_back(word);
+        }
+    });
+}
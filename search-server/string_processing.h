@@ -5,13 +5,24 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <string>
+#include <string_view>
 
 #include "document.h"
+#include "stop_word_set.h"
 
 using namespace std::string_literals;
 
+// Слова text между пробелами, включая пустые между соседними пробелами.
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// То же, но слова складываются в буфер words, который сначала очищается.
+// Возвращает false, если в тексте есть символы с кодами от 0 до 31.
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
+// То же за тот же один проход, но без слов из stop_words.
+bool SplitIntoWordsNoStop(std::string_view text, const StopWordSet& stop_words, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
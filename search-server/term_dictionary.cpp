@@ -0,0 +1,76 @@
+#include "term_dictionary.h"
+
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : words_(other.words_)
+{
+    word_to_id_.reserve(words_.size());
+    for (TermId term_id = 0; term_id < words_.size(); ++term_id) {
+        word_to_id_.emplace(words_[term_id], term_id);
+    }
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        *this = TermDictionary(other);
+    }
+    return *this;
+}
+
+TermId TermDictionary::Intern(std::string_view word) {
+    const auto it = word_to_id_.find(word);
+    if (it != word_to_id_.end()) {
+        return it->second;
+    }
+
+    if (words_.size() >= NO_TERM) {
+        throw std::length_error("Too many distinct words in the dictionary"s);
+    }
+
+    const TermId term_id = static_cast<TermId>(words_.size());
+    words_.emplace_back(word);
+    word_to_id_.emplace(words_.back(), term_id);
+    return term_id;
+}
+
+TermId TermDictionary::Find(std::string_view word) const {
+    const auto it = word_to_id_.find(word);
+    return it == word_to_id_.end() ? NO_TERM : it->second;
+}
+
+std::string_view TermDictionary::GetWord(TermId term_id) const {
+    return words_.at(term_id);
+}
+
+size_t TermDictionary::GetMemoryUsage() const noexcept {
+    size_t memory_usage = sizeof(*this) + word_to_id_.bucket_count() * sizeof(void*)
+                        + word_to_id_.size() * (sizeof(decltype(word_to_id_)::value_type) + sizeof(void*));
+    for (const std::string& word : words_) {
+        memory_usage += sizeof(word) + word.capacity();
+    }
+    return memory_usage;
+}
+
+std::vector<TermId> TermDictionary::Compact(const std::vector<bool>& is_live) {
+    std::vector<TermId> new_ids(words_.size(), NO_TERM);
+    std::deque<std::string> words;
+    for (TermId term_id = 0; term_id < words_.size(); ++term_id) {
+        if (is_live[term_id]) {
+            new_ids[term_id] = static_cast<TermId>(words.size());
+            words.push_back(std::move(words_[term_id]));
+            words.back().shrink_to_fit();
+        }
+    }
+
+    std::unordered_map<std::string_view, TermId> word_to_id;
+    word_to_id.reserve(words.size());
+    for (TermId term_id = 0; term_id < words.size(); ++term_id) {
+        word_to_id.emplace(words[term_id], term_id);
+    }
+    words_ = std::move(words);
+    word_to_id_ = std::move(word_to_id);
+    return new_ids;
+}
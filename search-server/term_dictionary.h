@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+
+// Словарь терминов: каждое уникальное слово хранится один раз
+// и получает плотный 32-битный идентификатор.
+class TermDictionary {
+public:
+    static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+    TermDictionary() = default;
+    // Индекс слов ссылается на строки самого словаря, поэтому при
+    // копировании он строится заново.
+    TermDictionary(const TermDictionary& other);
+    TermDictionary(TermDictionary&& other) = default;
+    TermDictionary& operator=(const TermDictionary& other);
+    TermDictionary& operator=(TermDictionary&& other) = default;
+
+    TermId Intern(std::string_view word);
+
+    TermId Find(std::string_view word) const;
+
+    std::string_view GetWord(TermId term_id) const;
+
+    size_t size() const noexcept {
+        return words_.size();
+    }
+
+    // Оценка занятой словарём памяти в байтах.
+    size_t GetMemoryUsage() const noexcept;
+
+    // Оставляет только слова с is_live[term_id] и нумерует их заново
+    // в прежнем порядке. Возвращает новый id для каждого старого или
+    // NO_TERM для удалённых. Все string_view на слова словаря
+    // становятся недействительными.
+    std::vector<TermId> Compact(const std::vector<bool>& is_live);
+
+private:
+    std::deque<std::string> words_;
+    std::unordered_map<std::string_view, TermId> word_to_id_;
+};
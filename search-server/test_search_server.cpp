@@ -1,13 +1,45 @@
 #include "test_search_server.h"
+#include "versioned_search_server.h"
+#include "segmented_search_server.h"
+#include "sharded_search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "query_metrics.h"
+#include "benchmark.h"
+#include "index_snapshot.h"
+#include "concurrent_map.h"
 
 #include <vector>
 #include <string>
 #include <string_view>
 #include <cmath>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <atomic>
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
 
+// Словарь для тестов на множестве документов; "and" в них — стоп-слово.
+const std::vector<std::string> TEST_WORDS = {"cat"s, "dog"s, "parrot"s, "fluffy"s, "groomed"s,
+                                             "tail"s, "collar"s, "eyes"s, "starling"s, "and"s};
+
+// Текст документа document_id из word_count слов TEST_WORDS. Слова
+// выбираются по id, так что тексты документов повторяются и пересекаются.
+std::string MakeTestText(int document_id, int word_count) {
+    std::string text;
+    for (int i = 0; i < word_count; ++i) {
+        text += TEST_WORDS[(document_id * 7 + i * i * 3) % TEST_WORDS.size()] + " "s;
+    }
+    return text;
+}
+
 void TestNoStopWords() {
     const int doc_id = 42;
     const std::string content = "cat in the city"s;
@@ -137,6 +169,47 @@ void TestMatchingDocuments() {
     }
 }
 
+void TestMatchedWordsOutliveQuery() {
+    SearchServer server("in the"s);
+    server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+
+    std::vector<std::string_view> words;
+    {
+        std::string query = "tail cat dog"s;
+        words = std::get<0>(server.MatchDocument(query, 1));
+        query.assign(query.size(), 'x');
+    }
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT_EQUAL(words.at(0), "cat"s);
+    ASSERT_EQUAL(words.at(1), "tail"s);
+}
+
+void TestMatchingDocumentsInBatch() {
+    SearchServer server("and in on"s);
+    server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+    server.AddDocument(3, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(4, "groomed cat in the city"s, DocumentStatus::IRRELEVANT, {1});
+    const SearchServer& const_server = server;
+    const std::vector<int> document_ids = {4, 1, 2, 3, 1};
+
+    for (const std::string& query : {"fluffy groomed cat"s, "cat -groomed"s, "tail tail -collar dog"s, "parrot"s}) {
+        const auto seq_results = const_server.MatchDocuments(query, document_ids);
+        const auto par_results = const_server.MatchDocuments(std::execution::par, query, document_ids);
+        ASSERT_EQUAL_HINT(seq_results.size(), document_ids.size(), query);
+        ASSERT_HINT(seq_results == par_results, query);
+        for (size_t i = 0; i < document_ids.size(); ++i) {
+            ASSERT_HINT(seq_results[i] == const_server.MatchDocument(query, document_ids[i]), query);
+        }
+    }
+
+    try {
+        const_server.MatchDocuments("cat"s, {1, 5});
+        ASSERT_HINT(false, "Matching an unknown document must throw"s);
+    } catch (const std::out_of_range&) {
+    }
+}
+
 void TestSortingByRelevance() {
     {
         SearchServer server("in the"s);
@@ -247,6 +320,1382 @@ void TestRelevanceCalculation() {
     }
 }
 
+void TestRelevanceUpdatedAfterIndexChanges() {
+    SearchServer server("and in on"s);
+    server.AddDocument(0, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+
+    const auto found_docs = server.FindTopDocuments("fluffy"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_HINT(std::abs(found_docs[0].relevance - std::log(3.0) * 0.5) < 1e-9, "Wrong relevance"s);
+
+    server.AddDocument(3, "groomed starling evgeny"s, DocumentStatus::ACTUAL, {9});
+    const auto found_docs_after_add = server.FindTopDocuments("fluffy"s);
+    ASSERT_EQUAL(found_docs_after_add.size(), 1u);
+    ASSERT_HINT(std::abs(found_docs_after_add[0].relevance - std::log(4.0) * 0.5) < 1e-9, "IDF must be recomputed after AddDocument"s);
+
+    server.RemoveDocument(0);
+    server.RemoveDocument(2);
+    const auto found_docs_after_remove = server.FindTopDocuments(std::execution::par, "fluffy"s);
+    ASSERT_EQUAL(found_docs_after_remove.size(), 1u);
+    ASSERT_HINT(std::abs(found_docs_after_remove[0].relevance - std::log(2.0) * 0.5) < 1e-9, "IDF must be recomputed after RemoveDocument"s);
+}
+
+void TestRemovingDocuments() {
+    {
+        SearchServer server("and in on"s);
+        server.AddDocument(3, "groomed starling evgeny"s, DocumentStatus::ACTUAL, {9});
+        server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+        server.RemoveDocument(3);
+        const auto found_docs = server.FindTopDocuments("groomed cat"s);
+        ASSERT_EQUAL(found_docs.size(), 2u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT_HINT(server.GetWordFrequencies(3).empty(), "Removed document must have no words"s);
+    }
+
+    {
+        SearchServer server("and in on"s);
+        server.AddDocument(3, "groomed starling evgeny"s, DocumentStatus::ACTUAL, {9});
+        server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+        server.RemoveDocument(std::execution::par, 2);
+        const auto found_docs = server.FindTopDocuments("groomed"s);
+        ASSERT_EQUAL(found_docs.size(), 1u);
+        ASSERT_EQUAL(found_docs[0].id, 3);
+    }
+}
+
+void TestPrunedTopDocumentsMatchExhaustiveSearch() {
+    SearchServer server("and in on"s);
+    const int document_count = 20000;
+    for (int document_id = 0; document_id < document_count; ++document_id) {
+        server.AddDocument(document_id, MakeTestText(document_id, 1 + document_id % 5), DocumentStatus::ACTUAL, {document_id});
+    }
+
+    std::map<std::string_view, int> document_freqs;
+    for (const int document_id : server) {
+        for (const auto& [word, _] : server.GetWordFrequencies(document_id)) {
+            ++document_freqs[word];
+        }
+    }
+
+    const auto find_exhaustive = [&](const std::set<std::string_view>& plus_words, const std::set<std::string_view>& minus_words) {
+        std::vector<Document> documents;
+        for (const int document_id : server) {
+            double relevance = 0.0;
+            bool is_matched = false;
+            bool is_excluded = false;
+            for (const auto& [word, term_freq] : server.GetWordFrequencies(document_id)) {
+                if (minus_words.count(word)) {
+                    is_excluded = true;
+                }
+                if (plus_words.count(word)) {
+                    relevance += term_freq * std::log(document_count * 1.0 / document_freqs.at(word));
+                    is_matched = true;
+                }
+            }
+            if (is_matched && !is_excluded) {
+                documents.push_back({document_id, relevance, document_id});
+            }
+        }
+        std::sort(documents.begin(), documents.end(), [](const Document& lhs, const Document& rhs) {
+            if (std::abs(lhs.relevance - rhs.relevance) < RESEDUAL_OF_DOCUMENT_RELEVANCE) {
+                return lhs.rating > rhs.rating;
+            }
+            return lhs.relevance > rhs.relevance;
+        });
+        documents.resize(std::min<size_t>(documents.size(), MAX_RESULT_DOCUMENT_COUNT));
+        return documents;
+    };
+
+    const std::vector<std::pair<std::set<std::string_view>, std::set<std::string_view>>> queries = {
+        {{"cat"sv}, {}},
+        {{"fluffy"sv, "cat"sv}, {}},
+        {{"groomed"sv, "dog"sv}, {"eyes"sv}},
+        {{"tail"sv, "collar"sv, "starling"sv}, {"cat"sv}},
+        {{"cat"sv, "dog"sv, "tail"sv, "collar"sv, "fluffy"sv, "groomed"sv, "eyes"sv, "starling"sv}, {}},
+    };
+    for (const auto& [plus_words, minus_words] : queries) {
+        std::string query;
+        for (const std::string_view word : plus_words) {
+            query += std::string(word) + " "s;
+        }
+        for (const std::string_view word : minus_words) {
+            query += "-"s + std::string(word) + " "s;
+        }
+
+        const auto expected_docs = find_exhaustive(plus_words, minus_words);
+        for (const auto& found_docs : {server.FindTopDocuments(std::execution::seq, query), server.FindTopDocuments(std::execution::par, query)}) {
+            ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+                ASSERT_HINT(std::abs(found_docs[i].relevance - expected_docs[i].relevance) < 1e-9, query);
+            }
+        }
+    }
+}
+
+void TestPostingsKeptSortedOnOutOfOrderUpdates() {
+    SearchServer server;
+    // Документы добавляются вразнобой, чтобы вставки шли в середину
+    // уже заполненных блоков постинг-листа и блоки делились.
+    const int document_count = 1000;
+    for (int i = 0; i < document_count; ++i) {
+        const int document_id = (i * 337) % document_count;
+        server.AddDocument(document_id, document_id % 3 == 0 ? "cat cat dog"s : "cat"s, DocumentStatus::ACTUAL, {document_id});
+    }
+    for (int document_id = 0; document_id < document_count; document_id += 2) {
+        server.RemoveDocument(document_id);
+    }
+
+    for (int document_id = 1; document_id < document_count; document_id += 2) {
+        const auto [matched_words, _] = server.MatchDocument("dog"s, document_id);
+        ASSERT_EQUAL(matched_words.size(), document_id % 3 == 0 ? 1u : 0u);
+    }
+
+    const auto found_docs = server.FindTopDocuments("dog"s);
+    ASSERT_EQUAL(found_docs.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT_EQUAL(found_docs[0].id, 999);
+    ASSERT_EQUAL(found_docs[1].id, 993);
+}
+
+void TestSnapshotRoundTrip() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+    {
+        SearchServer server("and in on"s);
+        server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+        server.AddDocument(3, "groomed starling evgeny"s, DocumentStatus::ACTUAL, {9});
+        server.AddDocument(4, "in and on"s, DocumentStatus::ACTUAL, {});
+        for (int document_id = 5; document_id < 300; ++document_id) {
+            server.AddDocument(document_id, document_id % 2 ? "white cat"s : "cat and dog"s, DocumentStatus::ACTUAL, {document_id});
+        }
+        server.SaveSnapshot(path);
+    }
+
+    SearchServer server = SearchServer::LoadSnapshot(path);
+    ASSERT_EQUAL(server.GetDocumentCount(), 299);
+    ASSERT(server.GetWordFrequencies(4).empty());
+    ASSERT(server.FindTopDocuments("in"s).empty());
+    ASSERT_EQUAL(std::get<1>(server.MatchDocument("groomed"s, 2)), DocumentStatus::BANNED);
+
+    const auto found_docs = server.FindTopDocuments("fluffy groomed cat"s);
+    ASSERT_EQUAL(found_docs.size(), 5u);
+    ASSERT_EQUAL(found_docs[0].id, 1);
+    ASSERT_EQUAL(found_docs[0].rating, 5);
+    ASSERT_EQUAL(found_docs[1].id, 3);
+
+    // Загруженный сервер можно изменять.
+    server.RemoveDocument(1);
+    server.AddDocument(1000, "fluffy starling"s, DocumentStatus::ACTUAL, {});
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy"s)[0].id, 1000);
+
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    // Слово словаря, которое AddDocument не принял бы.
+    bytes[bytes.find("fluffy"s)] = '\x12';
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), bytes.size());
+    }
+    try {
+        SearchServer::LoadSnapshot(path);
+        ASSERT_HINT(false, "Snapshot with an invalid word must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(0);
+        file.put('X');
+    }
+    try {
+        SearchServer::LoadSnapshot(path);
+        ASSERT_HINT(false, "Corrupted snapshot must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+    std::filesystem::remove(path);
+}
+
+void TestAddingDocumentsInBatch() {
+    const std::vector<std::string> texts = {"fluffy cat fluffy tail"s, "groomed dog expressive eyes"s, "groomed starling evgeny"s,
+                                            "white cat and fancy collar"s, "cat in the city"s};
+    SearchServer expected_server("and in on"s);
+    std::vector<NewDocument> batch;
+    for (int document_id = 0; document_id < 1000; ++document_id) {
+        const std::string& text = texts[document_id % texts.size()];
+        expected_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id});
+        batch.push_back({document_id, text, DocumentStatus::ACTUAL, {document_id}});
+    }
+    batch.push_back({-1, "cat"sv, DocumentStatus::ACTUAL, {}});
+    batch.push_back({7, "cat"sv, DocumentStatus::ACTUAL, {}});
+    batch.push_back({1000, "big\x12 cat"sv, DocumentStatus::ACTUAL, {}});
+    batch.push_back({2000, "cat"sv, DocumentStatus::ACTUAL, {}});
+    // Первый документ с id 3000 отвергается из-за текста и не мешает второму.
+    batch.push_back({3000, "big\x12 dog"sv, DocumentStatus::ACTUAL, {}});
+    batch.push_back({3000, "parrot"sv, DocumentStatus::ACTUAL, {}});
+
+    for (const bool is_parallel : {false, true}) {
+        SearchServer server("and in on"s);
+        server.AddDocument(2000, "dog"s, DocumentStatus::ACTUAL, {});
+        const auto errors = is_parallel ? server.AddDocuments(std::execution::par, batch) : server.AddDocuments(batch);
+        ASSERT_EQUAL(errors.size(), batch.size());
+        ASSERT(std::all_of(errors.begin(), errors.begin() + 1000, [](const std::exception_ptr& error) { return error == nullptr; }));
+        ASSERT(errors.back() == nullptr);
+        for (size_t i = 1000; i + 1 < batch.size(); ++i) {
+            ASSERT(errors[i] != nullptr);
+            try {
+                std::rethrow_exception(errors[i]);
+            } catch (const std::invalid_argument&) {
+            }
+        }
+
+        ASSERT_EQUAL(server.GetDocumentCount(), 1002);
+        ASSERT_EQUAL(server.FindTopDocuments("parrot"s).at(0).id, 3000);
+        for (int document_id = 0; document_id < 1000; ++document_id) {
+            ASSERT(server.GetWordFrequencies(document_id) == expected_server.GetWordFrequencies(document_id));
+        }
+        for (const std::string& query : {"cat"s, "groomed -dog"s, "fluffy starling collar"s}) {
+            const auto found_docs = server.FindTopDocuments(query);
+            const auto expected_docs = expected_server.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+            }
+        }
+    }
+}
+
+void TestCompactionDropsDeadTerms() {
+    SearchServer server("and in on"s);
+    SearchServer expected_server("and in on"s);
+    for (int document_id = 0; document_id < 500; ++document_id) {
+        const std::string text = "cat word"s + std::to_string(document_id) + (document_id % 2 == 0 ? " dog"s : " parrot"s);
+        server.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id % 7});
+        if (document_id % 5 == 0) {
+            expected_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, {document_id % 7});
+        }
+    }
+    for (int document_id = 0; document_id < 500; ++document_id) {
+        if (document_id % 5 != 0) {
+            server.RemoveDocument(document_id);
+        }
+    }
+    ASSERT(server.GetDeadBytes() > 0);
+
+    const CompactionStats stats = server.Compact();
+    ASSERT_EQUAL(stats.removed_terms, 400u);
+    ASSERT_EQUAL(stats.removed_document_slots, 400u);
+    ASSERT(stats.reclaimed_bytes > 0);
+    ASSERT_EQUAL(server.GetDeadBytes(), 0u);
+    ASSERT_EQUAL(server.Compact().removed_terms, 0u);
+
+    for (int document_id = 0; document_id < 500; document_id += 5) {
+        ASSERT(server.GetWordFrequencies(document_id) == expected_server.GetWordFrequencies(document_id));
+    }
+    for (const std::string& query : {"cat"s, "word15 dog"s, "parrot -word25"s, "word16"s}) {
+        const auto found_docs = server.FindTopDocuments(query);
+        const auto expected_docs = expected_server.FindTopDocuments(query);
+        ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+        }
+        ASSERT(server.MatchDocuments(query, {0, 5, 10}) == expected_server.MatchDocuments(query, {0, 5, 10}));
+    }
+
+    server.AddDocument(1000, "word16 hamster"s, DocumentStatus::ACTUAL, {});
+    ASSERT_EQUAL(server.FindTopDocuments("word16"s).size(), 1u);
+
+    // Удаление не сжимает словарь даже при достигнутом пороге, так что
+    // слова других документов остаются на месте до явного сжатия.
+    server.SetCompactionThreshold(1);
+    const auto [matched_words, _] = server.MatchDocument("word15 dog"s, 15);
+    server.RemoveDocument(std::execution::par, 1000);
+    ASSERT(server.GetDeadBytes() > 0);
+    ASSERT(matched_words == (std::vector<std::string_view>{"word15"sv}));
+    ASSERT(server.CompactIfNeeded().has_value());
+    ASSERT_EQUAL(server.GetDeadBytes(), 0u);
+    ASSERT(!server.CompactIfNeeded().has_value());
+    ASSERT(server.FindTopDocuments("hamster"s).empty());
+
+    // Номера удалённых документов освобождаются, поэтому при постоянной
+    // замене документов память не растёт.
+    server.SetCompactionThreshold(4096);
+    const size_t memory_usage = server.GetMemoryUsage();
+    for (int document_id = 2000; document_id < 12000; ++document_id) {
+        server.AddDocument(document_id, "cat churn"s, DocumentStatus::ACTUAL, {});
+        server.RemoveDocument(document_id);
+        server.CompactIfNeeded();
+    }
+    ASSERT_EQUAL(server.Compact().removed_terms, 1u);
+    ASSERT(server.GetMemoryUsage() <= memory_usage);
+    for (const std::string& query : {"cat"s, "word15 dog"s, "parrot -word25"s}) {
+        const auto found_docs = server.FindTopDocuments(query);
+        const auto expected_docs = expected_server.FindTopDocuments(query);
+        ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+            ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+        }
+    }
+}
+
+void TestReadersSeeConsistentVersions() {
+    VersionedSearchServer server(SearchServer("and in on"s));
+    server.AddDocuments({{0, "cat"sv, DocumentStatus::ACTUAL, {}}});
+    const std::shared_ptr<const SearchServer> first_version = server.Acquire();
+
+    std::atomic<bool> is_done = false;
+    std::atomic<int> read_count = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&server, &is_done, &read_count] {
+            int last_document_count = 0;
+            while (!is_done.load()) {
+                const std::shared_ptr<const SearchServer> version = server.Acquire();
+                const int document_count = version->GetDocumentCount();
+                ASSERT(document_count >= last_document_count);
+                const std::vector<int> document_ids(version->cbegin(), version->cend());
+                ASSERT_EQUAL(static_cast<int>(document_ids.size()), document_count);
+                for (const auto& [words, _] : version->MatchDocuments("cat dog"s, document_ids)) {
+                    ASSERT_EQUAL(words.size(), 1u);
+                }
+                last_document_count = document_count;
+                ++read_count;
+            }
+        });
+    }
+
+    // Версии публикуются пакетами по 10 документов.
+    for (int first_id = 1; first_id < 200; first_id += 10) {
+        std::vector<NewDocument> batch;
+        for (int document_id = first_id; document_id < std::min(first_id + 10, 200); ++document_id) {
+            batch.push_back({document_id, document_id % 2 == 0 ? "cat"sv : "dog"sv, DocumentStatus::ACTUAL, {}});
+        }
+        server.AddDocuments(batch);
+    }
+    server.Update([](SearchServer& next) {
+        for (int document_id = 200; document_id < 300; ++document_id) {
+            next.AddDocument(document_id, "dog"s, DocumentStatus::ACTUAL, {});
+        }
+    });
+    try {
+        server.Update([](SearchServer& next) {
+            next.AddDocument(300, "dog"s, DocumentStatus::ACTUAL, {});
+            next.AddDocument(0, "dog"s, DocumentStatus::ACTUAL, {});
+        });
+        ASSERT_HINT(false, "Duplicate document id must throw"s);
+    } catch (const std::invalid_argument&) {
+    }
+    while (read_count.load() < 100) {
+        std::this_thread::yield();
+    }
+    is_done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    ASSERT_EQUAL(server.GetDocumentCount(), 300);
+    ASSERT_EQUAL(first_version->GetDocumentCount(), 1);
+    ASSERT_EQUAL(first_version->FindTopDocuments("dog"s).size(), 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("dog"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    const std::shared_ptr<const SearchServer> full_version = server.Acquire();
+    server.RemoveDocuments({0, 2, 4});
+    ASSERT_EQUAL(server.GetDocumentCount(), 297);
+    try {
+        server.RemoveDocuments({6, 1000});
+        ASSERT_HINT(false, "Removing a missing document must throw"s);
+    } catch (const std::out_of_range&) {
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 297);
+    ASSERT_EQUAL(full_version->GetDocumentCount(), 300);
+}
+
+void TestSegmentedIndexMatchesSingleIndex() {
+    const auto make_text = [](int document_id) {
+        return MakeTestText(document_id, 1 + document_id % 5);
+    };
+
+    for (const bool merge_in_background : {false, true}) {
+        SegmentedSearchServer server("and in on"s, SegmentMergePolicy{16, 3, merge_in_background});
+        SearchServer expected_server("and in on"s);
+        for (int document_id = 0; document_id < 600; ++document_id) {
+            const DocumentStatus status = document_id % 11 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+            server.AddDocument(document_id, make_text(document_id), status, {document_id});
+            expected_server.AddDocument(document_id, make_text(document_id), status, {document_id});
+            if (document_id % 3 == 0 && document_id >= 30) {
+                server.RemoveDocument(document_id - 30);
+                expected_server.RemoveDocument(document_id - 30);
+            }
+        }
+        for (int document_id = 0; document_id < 90; document_id += 9) {
+            server.AddDocument(document_id, "cat dog"s, DocumentStatus::ACTUAL, {100 + document_id});
+            expected_server.AddDocument(document_id, "cat dog"s, DocumentStatus::ACTUAL, {100 + document_id});
+        }
+        try {
+            server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {});
+            ASSERT_HINT(false, "Duplicate document id must throw"s);
+        } catch (const std::invalid_argument&) {
+        }
+
+        for (const bool is_merged : {false, true}) {
+            if (is_merged) {
+                server.Flush();
+                server.WaitForMerges();
+                ASSERT(server.GetSegmentCount() < 600 / 16);
+            }
+            ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+            for (const std::string& query : {"cat"s, "dog -tail"s, "fluffy groomed parrot"s, "collar eyes -cat"s}) {
+                const auto expected_docs = expected_server.FindTopDocuments(query);
+                for (const auto& found_docs : {server.FindTopDocuments(query), server.FindTopDocuments(std::execution::par, query)}) {
+                    ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+                    for (size_t i = 0; i < found_docs.size(); ++i) {
+                        ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+                        ASSERT_HINT(std::abs(found_docs[i].relevance - expected_docs[i].relevance) < 1e-6, query);
+                    }
+                }
+                ASSERT_EQUAL(server.FindTopDocuments(query, DocumentStatus::BANNED).size(),
+                             expected_server.FindTopDocuments(query, DocumentStatus::BANNED).size());
+            }
+            for (int document_id = 570; document_id < 600; ++document_id) {
+                ASSERT(server.MatchDocument("cat -eyes"s, document_id) == expected_server.MatchDocument("cat -eyes"s, document_id));
+            }
+        }
+    }
+}
+
+void TestShardedIndexMatchesSingleIndex() {
+    ShardedSearchServer server("and in on"s, 4);
+    SearchServer expected_server("and in on"s);
+    std::vector<std::string> texts;
+    std::vector<NewDocument> batch;
+    for (int document_id = 0; document_id < 400; ++document_id) {
+        texts.push_back(MakeTestText(document_id, 1 + document_id % 5));
+    }
+    for (int document_id = 0; document_id < 400; ++document_id) {
+        const DocumentStatus status = document_id % 11 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        if (document_id < 200) {
+            server.AddDocument(document_id, texts[document_id], status, {document_id});
+        } else {
+            batch.push_back({document_id, texts[document_id], status, {document_id}});
+        }
+        expected_server.AddDocument(document_id, texts[document_id], status, {document_id});
+    }
+    batch.push_back({5, "cat"sv, DocumentStatus::ACTUAL, {}});
+    const auto errors = server.AddDocuments(batch);
+    ASSERT(std::all_of(errors.begin(), errors.end() - 1, [](const std::exception_ptr& error) { return error == nullptr; }));
+    ASSERT(errors.back() != nullptr);
+    for (int document_id = 0; document_id < 400; document_id += 7) {
+        server.RemoveDocument(document_id);
+        expected_server.RemoveDocument(document_id);
+    }
+
+    ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+    for (size_t i = 0; i < server.GetShardCount(); ++i) {
+        ASSERT(server.GetShard(i).GetDocumentCount() > 0);
+    }
+    for (const std::string& query : {"cat"s, "dog -tail"s, "fluffy groomed parrot"s, "collar eyes -cat"s}) {
+        const auto expected_docs = expected_server.FindTopDocuments(query);
+        for (const auto& found_docs : {server.FindTopDocuments(query), server.FindTopDocuments(std::execution::par, query)}) {
+            ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+                ASSERT_HINT(std::abs(found_docs[i].relevance - expected_docs[i].relevance) < 1e-6, query);
+            }
+        }
+        const std::vector<int> document_ids = {1, 2, 3, 4, 5, 6, 8, 9, 10, 398};
+        ASSERT(server.MatchDocuments(query, document_ids) == expected_server.MatchDocuments(query, document_ids));
+        ASSERT(server.MatchDocument(query, 8) == expected_server.MatchDocument(query, 8));
+    }
+
+    // Поиск по статусу идёт в шардах по спискам статуса и через их кэш.
+    // После изменения одного шарда IDF меняются и для остальных,
+    // хотя их версии индекса прежние.
+    server.SetResultCacheCapacity(16);
+    const auto expect_same_top = [&server, &expected_server](const std::string& query, DocumentStatus status) {
+        const auto expected_docs = expected_server.FindTopDocuments(query, status);
+        for (const auto& found_docs : {server.FindTopDocuments(query, status), server.FindTopDocuments(std::execution::par, query, status)}) {
+            ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < found_docs.size(); ++i) {
+                ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+                ASSERT_HINT(std::abs(found_docs[i].relevance - expected_docs[i].relevance) < 1e-6, query);
+            }
+        }
+    };
+    for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+        expect_same_top("dog -tail"s, status);
+        expect_same_top("fluffy groomed parrot"s, status);
+    }
+    ASSERT(server.GetResultCacheStats().hit_count > 0);
+    server.AddDocument(1000, "dog dog"s, DocumentStatus::ACTUAL, {});
+    expected_server.AddDocument(1000, "dog dog"s, DocumentStatus::ACTUAL, {});
+    for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+        expect_same_top("dog -tail"s, status);
+    }
+
+    try {
+        server.FindTopDocuments(std::execution::par, "cat --dog"s);
+        ASSERT_HINT(false, "Invalid query must throw"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void TestProcessQueriesOnExecutor() {
+    SearchServer server("and in on"s);
+    for (int document_id = 0; document_id < 300; ++document_id) {
+        server.AddDocument(document_id, MakeTestText(document_id, 2), DocumentStatus::ACTUAL, {document_id});
+    }
+    std::vector<std::string> queries;
+    for (int i = 0; i < 500; ++i) {
+        queries.push_back(TEST_WORDS[i % TEST_WORDS.size()] + " -"s + TEST_WORDS[i * 3 % TEST_WORDS.size()]);
+    }
+
+    QueryExecutor executor(3);
+    ASSERT_EQUAL(executor.GetWorkerCount(), 3u);
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        const auto results = ProcessQueries(executor, server, queries);
+        ASSERT_EQUAL(results.size(), queries.size());
+        std::vector<Document> joined;
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const auto expected_docs = server.FindTopDocuments(queries[i]);
+            ASSERT_EQUAL_HINT(results[i].size(), expected_docs.size(), queries[i]);
+            for (size_t j = 0; j < expected_docs.size(); ++j) {
+                ASSERT_EQUAL_HINT(results[i][j].id, expected_docs[j].id, queries[i]);
+            }
+            joined.insert(joined.end(), expected_docs.begin(), expected_docs.end());
+        }
+        const auto found_joined = ProcessQueriesJoined(executor, server, queries);
+        ASSERT_EQUAL(found_joined.size(), joined.size());
+        for (size_t i = 0; i < joined.size(); ++i) {
+            ASSERT_EQUAL(found_joined[i].id, joined[i].id);
+        }
+    }
+
+    queries[250] = "cat --dog"s;
+    try {
+        ProcessQueries(executor, server, queries);
+        ASSERT_HINT(false, "Invalid query must throw"s);
+    } catch (const std::invalid_argument&) {
+    }
+    ASSERT_EQUAL(ProcessQueries(executor, server, {"cat"s}).size(), 1u);
+}
+
+void TestProcessQueriesJoinedStreamsInOrder() {
+    SearchServer server("and in on"s);
+    for (int document_id = 0; document_id < 200; ++document_id) {
+        server.AddDocument(document_id, MakeTestText(document_id, 2), DocumentStatus::ACTUAL, {document_id});
+    }
+    std::vector<std::string> queries;
+    for (int i = 0; i < 700; ++i) {
+        queries.push_back(TEST_WORDS[i % TEST_WORDS.size()] + " -"s + TEST_WORDS[i * 3 % TEST_WORDS.size()]);
+    }
+    std::vector<Document> expected;
+    for (const std::string& query : queries) {
+        const auto documents = server.FindTopDocuments(query);
+        expected.insert(expected.end(), documents.begin(), documents.end());
+    }
+
+    // Один поток обрабатывает запросы несколькими окнами, три потока — одним.
+    for (size_t worker_count : {1u, 3u}) {
+        QueryExecutor executor(worker_count);
+        std::vector<int> streamed_ids;
+        ProcessQueriesJoined(executor, server, queries, [&streamed_ids](const Document& document) {
+            streamed_ids.push_back(document.id);
+        });
+        ASSERT_EQUAL(streamed_ids.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(streamed_ids[i], expected[i].id);
+        }
+
+        size_t delivered_count = 0;
+        try {
+            ProcessQueriesJoined(executor, server, queries, [&delivered_count](const Document&) {
+                if (++delivered_count == 10) {
+                    throw std::runtime_error("Sink is full"s);
+                }
+            });
+            ASSERT_HINT(false, "Exception from sink must be rethrown"s);
+        } catch (const std::runtime_error&) {
+        }
+        ASSERT_EQUAL(delivered_count, 10u);
+    }
+}
+
+void TestResultCacheFollowsIndexVersion() {
+    SearchServer server("and in on"s);
+    server.AddDocument(1, "white cat and fashion collar"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, {5, -12, 2, 1});
+    ASSERT_EQUAL(server.GetResultCacheStats().miss_count, 0u);
+    server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(server.GetResultCacheStats().miss_count, 0u);
+
+    server.SetResultCacheCapacity(100);
+    const auto expected = server.FindTopDocuments("fluffy cat -dog"s);
+    ASSERT_EQUAL(expected.size(), 2u);
+    // Порядок и повторы слов не важны, незнакомые слова отбрасываются.
+    const auto cached = server.FindTopDocuments("-dog cat fluffy cat parrot"s);
+    ASSERT_EQUAL(cached.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(cached[i].id, expected[i].id);
+        ASSERT(std::abs(cached[i].relevance - expected[i].relevance) < 1e-6);
+    }
+    ASSERT_EQUAL(server.GetResultCacheStats().hit_count, 1u);
+    ASSERT_EQUAL(server.GetResultCacheStats().miss_count, 1u);
+
+    ASSERT_EQUAL(server.FindTopDocuments("cat fluffy -dog"s, DocumentStatus::BANNED).size(), 0u);
+    ASSERT_EQUAL(server.FindTopDocuments(std::execution::par, "cat fluffy -dog"s).size(), 2u);
+    ASSERT_EQUAL(server.GetResultCacheStats().hit_count, 2u);
+    ASSERT_EQUAL(server.GetResultCacheStats().miss_count, 2u);
+    ASSERT_EQUAL(server.GetResultCacheStats().entry_count, 2u);
+
+    server.AddDocument(4, "fluffy cat"s, DocumentStatus::ACTUAL, {9});
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy cat -dog"s).size(), 3u);
+    server.RemoveDocument(4);
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy cat -dog"s).size(), 2u);
+    ASSERT_EQUAL(server.GetResultCacheStats().hit_count, 2u);
+    ASSERT_EQUAL(server.GetResultCacheStats().miss_count, 4u);
+    ASSERT(std::abs(server.GetResultCacheStats().GetHitRate() - 2.0 / 6.0) < 1e-9);
+
+    SearchServer copy = server;
+    ASSERT_EQUAL(copy.GetResultCacheStats().entry_count, 0u);
+    copy.FindTopDocuments("fluffy cat -dog"s);
+    ASSERT_EQUAL(copy.GetResultCacheStats().miss_count, 1u);
+
+    SearchServer small_cache("and in on"s);
+    small_cache.SetResultCacheCapacity(1);
+    for (int document_id = 0; document_id < 50; ++document_id) {
+        small_cache.AddDocument(document_id, "word"s + std::to_string(document_id), DocumentStatus::ACTUAL, {1});
+    }
+    for (int document_id = 0; document_id < 50; ++document_id) {
+        small_cache.FindTopDocuments("word"s + std::to_string(document_id));
+    }
+    ASSERT_EQUAL(small_cache.GetResultCacheStats().entry_count, 1u);
+
+    // Ёмкость не кратна числу шардов: записей всё равно не больше неё.
+    SearchServer odd_cache = small_cache;
+    odd_cache.SetResultCacheCapacity(20);
+    for (int document_id = 0; document_id < 50; ++document_id) {
+        odd_cache.FindTopDocuments("word"s + std::to_string(document_id));
+    }
+    ASSERT(odd_cache.GetResultCacheStats().entry_count <= 20u);
+}
+
+void TestTokenizerMatchesWordByWordSplit() {
+    const auto split_naive = [](std::string_view text) {
+        std::vector<std::string_view> words;
+        while (true) {
+            const size_t space = text.find(' ');
+            words.push_back(text.substr(0, space));
+            if (space == text.npos) {
+                return words;
+            }
+            text.remove_prefix(space + 1);
+        }
+    };
+
+    // Пробелы и управляющие символы попадают на границы блоков по 16 и 32 байта.
+    const std::string alphabet = "ab \xD0\xBA"s;
+    uint32_t state = 17;
+    std::vector<std::string_view> words;
+    for (size_t size = 0; size < 100; ++size) {
+        std::string text;
+        for (size_t i = 0; i < size; ++i) {
+            state = state * 1103515245u + 12345u;
+            text += alphabet[(state >> 16) % alphabet.size()];
+        }
+        ASSERT(SplitIntoWords(text, words));
+        ASSERT_EQUAL(words, split_naive(text));
+        if (size > 0) {
+            std::string broken = text;
+            broken[(state >> 8) % size] = '\t';
+            ASSERT(!SplitIntoWords(broken, words));
+            ASSERT_EQUAL(words, split_naive(broken));
+        }
+    }
+
+    std::set<std::string, std::less<>> stop_word_strings;
+    for (int i = 0; i < 1000; ++i) {
+        stop_word_strings.insert("stop"s + std::to_string(i * 7));
+    }
+    const StopWordSet stop_words(stop_word_strings);
+    ASSERT_EQUAL(stop_words.size(), stop_word_strings.size());
+    for (int i = 0; i < 7000; ++i) {
+        ASSERT_EQUAL(stop_words.Contains("stop"s + std::to_string(i)), i % 7 == 0);
+    }
+    ASSERT(!stop_words.Contains(""s));
+    ASSERT(!StopWordSet().Contains("stop0"s));
+    const std::string text = "stop0 cat  stop7 stop8"s;
+    ASSERT(SplitIntoWordsNoStop(text, stop_words, words));
+    ASSERT_EQUAL(words, std::vector<std::string_view>({"cat"sv, ""sv, "stop8"sv}));
+
+    SearchServer server("in the"s);
+    try {
+        server.AddDocument(1, "a long document text that crosses a block\x01 boundary"s, DocumentStatus::ACTUAL, {1});
+        ASSERT_HINT(false, "Control character must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+    server.AddDocument(1, "a long document text in the middle of the block boundary"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.GetWordFrequencies(1).count("the"sv), 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("the boundary"s).size(), 1u);
+    try {
+        server.FindTopDocuments("the boundary of the block and the \x1F text"s);
+        ASSERT_HINT(false, "Control character must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void TestRemovingDuplicatesInBulk() {
+    SearchServer server("and with"s);
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    ASSERT_EQUAL(FindDuplicates(server), std::vector<int>({3, 4, 5, 7}));
+
+    server.RemoveDocuments(std::execution::par, FindDuplicates(server));
+    ASSERT_EQUAL(server.GetDocumentCount(), 5);
+    ASSERT(FindDuplicates(server).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("curly"s).size(), 2u);
+
+    // Массовое удаление даёт тот же индекс, что и удаление по одному.
+    SearchServer bulk("and in on"s);
+    SearchServer one_by_one("and in on"s);
+    for (int document_id = 0; document_id < 1000; ++document_id) {
+        const std::string document = MakeTestText(document_id, 2);
+        bulk.AddDocument(document_id, document, DocumentStatus::ACTUAL, {document_id});
+        one_by_one.AddDocument(document_id, document, DocumentStatus::ACTUAL, {document_id});
+    }
+    std::vector<int> removed_ids;
+    for (int document_id = 999; document_id >= 0; document_id -= 3) {
+        removed_ids.push_back(document_id);
+    }
+    removed_ids.push_back(999);
+    bulk.RemoveDocuments(removed_ids);
+    for (int document_id = 999; document_id >= 0; document_id -= 3) {
+        one_by_one.RemoveDocument(document_id);
+    }
+    ASSERT_EQUAL(bulk.GetDocumentCount(), one_by_one.GetDocumentCount());
+    for (const std::string& word : TEST_WORDS) {
+        const auto expected = one_by_one.FindTopDocuments(word);
+        const auto found = bulk.FindTopDocuments(word);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT(std::abs(found[i].relevance - expected[i].relevance) < 1e-6);
+        }
+    }
+
+    try {
+        bulk.RemoveDocuments({1, 999});
+        ASSERT_HINT(false, "Removing a missing document must throw"s);
+    } catch (const std::out_of_range&) {
+    }
+    ASSERT(bulk.HasDocument(1));
+}
+
+void TestFindingNearDuplicates() {
+    SearchServer server("and in on"s);
+    std::string article;
+    for (int i = 0; i < 40; ++i) {
+        article += "word"s + std::to_string(i) + " "s;
+    }
+    // Одна статья с разными подвалами, перемешанная с непохожими документами.
+    uint32_t state = 1;
+    for (int document_id = 0; document_id < 300; ++document_id) {
+        std::string document;
+        if (document_id % 50 == 7) {
+            document = article + "footer"s + std::to_string(document_id) + " "s + "copyright"s + std::to_string(document_id);
+        } else {
+            for (int i = 0; i < 40; ++i) {
+                state = state * 1103515245u + 12345u;
+                document += "term"s + std::to_string((state >> 8) % 100000) + " "s;
+            }
+        }
+        server.AddDocument(document_id, document, DocumentStatus::ACTUAL, {document_id});
+    }
+
+    const auto clusters = FindNearDuplicates(server);
+    ASSERT_EQUAL(clusters.size(), 1u);
+    ASSERT_EQUAL(clusters[0], std::vector<int>({7, 57, 107, 157, 207, 257}));
+
+    NearDuplicateOptions strict;
+    strict.similarity_threshold = 0.95;
+    ASSERT(FindNearDuplicates(server, strict).empty());
+
+    ASSERT_EQUAL(RemoveNearDuplicates(server), std::vector<int>({57, 107, 157, 207, 257}));
+    ASSERT_EQUAL(server.GetDocumentCount(), 295);
+    ASSERT(server.HasDocument(7));
+    ASSERT(FindNearDuplicates(server).empty());
+
+    // Цепочка A ~ B ~ C, где A и C между собой не похожи: сходство соседей
+    // 36/44, крайних — 32/48. C не попадает в группу A и не удаляется.
+    const auto make_words = [](int first_word) {
+        std::string text;
+        for (int i = first_word; i < first_word + 40; ++i) {
+            text += "chain"s + std::to_string(i) + " "s;
+        }
+        return text;
+    };
+    SearchServer chain_server(""s);
+    chain_server.AddDocument(1, make_words(0), DocumentStatus::ACTUAL, {});
+    chain_server.AddDocument(2, make_words(4), DocumentStatus::ACTUAL, {});
+    chain_server.AddDocument(3, make_words(8), DocumentStatus::ACTUAL, {});
+    NearDuplicateOptions lenient_lsh;
+    lenient_lsh.band_count = 32;
+    lenient_lsh.rows_per_band = 2;
+    const auto chain_clusters = FindNearDuplicates(chain_server, lenient_lsh);
+    ASSERT_EQUAL(chain_clusters.size(), 1u);
+    ASSERT_EQUAL(chain_clusters[0], std::vector<int>({1, 2}));
+    ASSERT_EQUAL(RemoveNearDuplicates(chain_server, lenient_lsh), std::vector<int>({2}));
+    ASSERT(chain_server.HasDocument(1) && chain_server.HasDocument(3));
+}
+
+void TestRequestQueueSlidingWindows() {
+    using namespace std::chrono_literals;
+    SearchServer server("and in on"s);
+    server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+
+    RequestQueue queue(server);
+    const RequestQueue::Clock::time_point start = RequestQueue::Clock::now();
+    for (int i = 0; i < 100; ++i) {
+        queue.RecordRequest(start + 1s, 100us, i % 10 == 0);
+    }
+    for (int i = 0; i < 20; ++i) {
+        queue.RecordRequest(start + 2min, 2ms, true);
+    }
+
+    const RequestWindowStats minute = queue.GetStats(RequestWindow::MINUTE, start + 2min + 1s);
+    ASSERT_EQUAL(minute.request_count, 20u);
+    ASSERT_EQUAL(minute.empty_result_count, 20u);
+    ASSERT(minute.latency_p50 >= 2ms && minute.latency_p50 < 2500us);
+
+    const RequestWindowStats five_minutes = queue.GetStats(RequestWindow::FIVE_MINUTES, start + 2min + 1s);
+    ASSERT_EQUAL(five_minutes.request_count, 120u);
+    ASSERT_EQUAL(five_minutes.empty_result_count, 30u);
+    ASSERT(std::abs(five_minutes.empty_result_rate - 0.25) < 1e-9);
+    ASSERT(five_minutes.requests_per_second > 0.9 && five_minutes.requests_per_second < 1.0);
+    ASSERT(five_minutes.latency_p50 >= 100us && five_minutes.latency_p50 < 125us);
+    ASSERT(five_minutes.latency_p99 >= 2ms);
+    ASSERT(five_minutes.latency_max >= 2ms);
+
+    ASSERT_EQUAL(queue.GetStats(RequestWindow::FIVE_MINUTES, start + 10min).request_count, 0u);
+    ASSERT_EQUAL(queue.GetStats(RequestWindow::HOUR, start + 30min).request_count, 120u);
+    ASSERT_EQUAL(queue.GetStats(RequestWindow::DAY, start + 23h).empty_result_count, 30u);
+    ASSERT_EQUAL(queue.GetStats(RequestWindow::DAY, start + 25h).request_count, 0u);
+
+    // Запросы из многих потоков учитываются все, пока статистику читают.
+    RequestQueue shared_queue(server);
+    std::atomic<bool> is_done = false;
+    std::thread reader([&] {
+        while (!is_done) {
+            shared_queue.GetStats(RequestWindow::MINUTE);
+        }
+    });
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < 4; ++worker) {
+        workers.emplace_back([&shared_queue] {
+            for (int i = 0; i < 500; ++i) {
+                shared_queue.AddFindRequest(i % 5 == 0 ? "parrot"s : "curly"s);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    is_done = true;
+    reader.join();
+    ASSERT_EQUAL(shared_queue.GetStats(RequestWindow::DAY).request_count, 2000u);
+    ASSERT_EQUAL(shared_queue.GetNoResultRequests(), 400);
+
+    try {
+        shared_queue.GetStats(static_cast<RequestWindow>(42));
+        ASSERT_HINT(false, "Unknown request window must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void TestQueryMetricsSnapshot() {
+    HdrHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    ASSERT_EQUAL(histogram.GetCount(), 1000u);
+    ASSERT_EQUAL(histogram.GetTotal(), 500500u);
+    ASSERT(histogram.GetPercentile(0.5) >= 500 && histogram.GetPercentile(0.5) <= 500 + 500 / 16);
+    ASSERT(histogram.GetPercentile(1.0) >= 1000 && histogram.GetPercentile(1.0) <= 1000 + 1000 / 16);
+
+    ResetQueryMetrics();
+    SearchServer server("and in on"s);
+    server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQUAL(server.FindTopDocuments("curly -collar"s).size(), 1u);
+    }
+
+    const std::string snapshot = GetQueryMetricsSnapshot();
+    if (QUERY_METRICS_ENABLED) {
+        ASSERT_HINT(snapshot.find("stage_ns.parse: count=10 "s) != std::string::npos, snapshot);
+        ASSERT_HINT(snapshot.find("stage_ns.minus_words: count=10 "s) != std::string::npos, snapshot);
+        ASSERT_HINT(snapshot.find("stage_ns.result_copy: count=10 "s) != std::string::npos, snapshot);
+        // В каждом запросе оценены оба документа по одному постингу.
+        ASSERT_HINT(snapshot.find("postings_scanned: count=10 p50=2 "s) != std::string::npos, snapshot);
+        ASSERT_HINT(snapshot.find("documents_scored: count=10 p50=2 "s) != std::string::npos, snapshot);
+    } else {
+        ASSERT_EQUAL(snapshot, "query metrics are disabled, build with SEARCH_SERVER_METRICS\n"s);
+    }
+}
+
+void TestQueryMetricsSkipFailedQueries() {
+    ResetQueryMetrics();
+    SearchServer server("and in on"s);
+    server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    SearchServer::QueryBuffers buffers;
+    try {
+        server.FindTopDocuments("curly --cat"s, DocumentStatus::ACTUAL, buffers);
+        ASSERT_HINT(false, "Invalid query must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+    // Пауза между запросами не должна попасть в разбор следующего.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQUAL(server.FindTopDocuments("curly"s, DocumentStatus::ACTUAL, buffers).size(), 1u);
+
+    const std::string snapshot = GetQueryMetricsSnapshot();
+    if (QUERY_METRICS_ENABLED) {
+        ASSERT_HINT(snapshot.find("stage_ns.parse: count=1 "s) != std::string::npos, snapshot);
+        const size_t total_position = snapshot.find("total="s, snapshot.find("stage_ns.parse:"s)) + "total="s.size();
+        ASSERT_HINT(std::stoull(snapshot.substr(total_position)) < 50'000'000u, snapshot);
+    }
+}
+
+void TestBenchmarkWorkloadIsReproducible() {
+    CorpusOptions corpus_options;
+    corpus_options.document_count = 2000;
+    corpus_options.vocabulary_size = 1000;
+    corpus_options.min_document_length = 5;
+    corpus_options.max_document_length = 15;
+    corpus_options.status_weights = {1.0, 0.0, 1.0, 0.0};
+    const Corpus corpus = GenerateCorpus(corpus_options);
+    const Corpus same_corpus = GenerateCorpus(corpus_options);
+    ASSERT_EQUAL(corpus.documents.size(), 2000u);
+    ASSERT_EQUAL(corpus.stop_words, same_corpus.stop_words);
+
+    std::map<std::string, int> word_counts;
+    std::map<DocumentStatus, int> status_counts;
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        const GeneratedDocument& document = corpus.documents[i];
+        ASSERT_EQUAL(document.text, same_corpus.documents[i].text);
+        ASSERT(document.status == same_corpus.documents[i].status);
+        ASSERT(document.ratings == same_corpus.documents[i].ratings);
+        const std::vector<std::string_view> words = SplitIntoWords(document.text);
+        ASSERT(words.size() >= 5 && words.size() <= 15);
+        for (const std::string_view word : words) {
+            ++word_counts[std::string(word)];
+        }
+        ++status_counts[document.status];
+    }
+    // При перекосе 1 самое частое слово встречается вдвое чаще второго.
+    ASSERT(word_counts["a"s] > word_counts["b"s] * 3 / 2);
+    ASSERT(word_counts["b"s] > word_counts["z"s]);
+    ASSERT_EQUAL(status_counts[DocumentStatus::IRRELEVANT] + status_counts[DocumentStatus::REMOVED], 0);
+    ASSERT(status_counts[DocumentStatus::ACTUAL] > 900 && status_counts[DocumentStatus::BANNED] > 900);
+
+    QueryOptions query_options;
+    query_options.query_count = 200;
+    const std::vector<std::string> queries = GenerateQueries(corpus_options, query_options);
+    ASSERT(queries == GenerateQueries(corpus_options, query_options));
+    const std::vector<std::string_view> stop_words = SplitIntoWords(corpus.stop_words);
+    ASSERT_EQUAL(stop_words.size(), corpus_options.stop_word_count);
+    for (const std::string& query : queries) {
+        for (std::string_view word : SplitIntoWords(query)) {
+            if (word[0] == '-') {
+                word.remove_prefix(1);
+            }
+            ASSERT_HINT(std::find(stop_words.begin(), stop_words.end(), word) == stop_words.end(), query);
+        }
+    }
+
+    try {
+        corpus_options.min_document_length = 20;
+        GenerateCorpus(corpus_options);
+        ASSERT_HINT(false, "Inverted document length range should be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+
+    // Версии seq и par находят одно и то же.
+    BenchmarkOptions benchmark_options;
+    benchmark_options.corpus.document_count = 300;
+    benchmark_options.queries.query_count = 100;
+    benchmark_options.batch_size = 64;
+    benchmark_options.remove_count = 50;
+    std::map<std::string, BenchmarkResult> results;
+    for (BenchmarkResult& result : RunBenchmarks(benchmark_options)) {
+        results[result.name] = std::move(result);
+    }
+    ASSERT_EQUAL(results.size(), 11u);
+    ASSERT_EQUAL(results["FindTopDocuments(seq)"s].item_count, 100u);
+    ASSERT(results["FindTopDocuments(seq)"s].result_count > 0);
+    ASSERT_EQUAL(results["FindTopDocuments(seq)"s].result_count, results["FindTopDocuments(par)"s].result_count);
+    ASSERT_EQUAL(results["FindTopDocuments(seq)"s].result_count, results["ProcessQueriesJoined"s].result_count);
+    ASSERT_EQUAL(results["MatchDocument(seq)"s].result_count, results["MatchDocument(par)"s].result_count);
+    ASSERT_EQUAL(results["AddDocuments(par)"s].item_count, 300u);
+    ASSERT_EQUAL(results["RemoveDocument(par)"s].item_count, 50u);
+}
+
+void TestStatusPartitionsMatchFilteredSearch() {
+    CorpusOptions corpus_options;
+    corpus_options.document_count = 600;
+    corpus_options.vocabulary_size = 300;
+    corpus_options.min_document_length = 5;
+    corpus_options.max_document_length = 30;
+    corpus_options.status_weights = {0.55, 0.15, 0.15, 0.15};
+    const Corpus corpus = GenerateCorpus(corpus_options);
+    QueryOptions query_options;
+    query_options.query_count = 60;
+    const std::vector<std::string> queries = GenerateQueries(corpus_options, query_options);
+
+    SearchServer server(corpus.stop_words);
+    const std::vector<NewDocument> documents = corpus.GetNewDocuments();
+    const size_t middle = documents.size() / 2;
+    for (size_t i = 0; i < middle; ++i) {
+        server.AddDocument(documents[i].id, documents[i].text, documents[i].status, documents[i].ratings);
+    }
+    server.AddDocuments(std::execution::par, std::vector<NewDocument>(documents.begin() + middle, documents.end()));
+
+    const auto check_queries = [&server, &queries] {
+        for (const std::string& query : queries) {
+            for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+                const DocumentStatus document_status = static_cast<DocumentStatus>(status);
+                const auto has_status = [document_status](int document_id, DocumentStatus status, int rating) {
+                    return status == document_status;
+                };
+                const std::vector<Document> expected = server.FindTopDocuments(query, has_status);
+                for (const std::vector<Document>& found : {server.FindTopDocuments(std::execution::seq, query, document_status),
+                                                           server.FindTopDocuments(std::execution::par, query, document_status)}) {
+                    ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+                    // При полном равенстве релевантности и рейтинга порядок не определён.
+                    for (size_t i = 0; i < found.size(); ++i) {
+                        ASSERT_HINT(std::abs(found[i].relevance - expected[i].relevance) < 1e-9, query);
+                        ASSERT_EQUAL_HINT(found[i].rating, expected[i].rating, query);
+                        ASSERT_EQUAL_HINT(std::get<1>(server.MatchDocument(query, found[i].id)), document_status, query);
+                    }
+                }
+            }
+        }
+    };
+    check_queries();
+
+    // Документы разных статусов со словом учитываются в IDF и находятся MatchDocument.
+    server.AddDocument(10001, "parrot"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(10002, "parrot"s, DocumentStatus::BANNED, {1});
+    ASSERT_EQUAL(server.GetDocumentFreq("parrot"s), 2u);
+    ASSERT(std::abs(server.FindTopDocuments("parrot"s)[0].relevance - std::log(server.GetDocumentCount() / 2.0)) < 1e-9);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument(std::execution::par, "parrot"s, 10002)).size(), 1u);
+    ASSERT(std::get<0>(server.MatchDocument("parrot -parrot"s, 10002)).empty());
+
+    std::vector<int> removed_ids;
+    for (int document_id = 1; document_id <= static_cast<int>(documents.size()); document_id += 3) {
+        removed_ids.push_back(document_id);
+    }
+    server.RemoveDocuments(std::execution::par, removed_ids);
+    server.RemoveDocument(std::execution::par, 2);
+    server.RemoveDocument(10002);
+    ASSERT_EQUAL(server.GetDocumentFreq("parrot"s), 1u);
+    ASSERT(server.FindTopDocuments("parrot"s, DocumentStatus::BANNED).empty());
+    check_queries();
+
+    server.Compact();
+    check_queries();
+}
+
+void TestDenseInternalIdsKeepExternalIds() {
+    SearchServer server("and in on"s);
+    server.AddDocument(1000000, "white cat"s, DocumentStatus::ACTUAL, {5});
+    server.AddDocument(7, "white dog"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocuments(std::execution::par, {{500, "white parrot"s, DocumentStatus::BANNED, {9}},
+                                              {42, "black cat"s, DocumentStatus::ACTUAL, {1}}});
+
+    // Внутренние номера выдаются по порядку добавления, но наружу видны только id.
+    ASSERT_EQUAL(std::vector<int>(server.begin(), server.end()), (std::vector<int>{7, 42, 500, 1000000}));
+    std::set<int> filtered_ids;
+    const auto collect_ids = [&filtered_ids](int document_id, DocumentStatus status, int rating) {
+        filtered_ids.insert(document_id);
+        return rating > 2;
+    };
+    const std::vector<Document> found = server.FindTopDocuments("white"s, collect_ids);
+    ASSERT_EQUAL(filtered_ids, (std::set<int>{7, 500, 1000000}));
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, 500);
+    ASSERT_EQUAL(found[0].rating, 9);
+    ASSERT_EQUAL(std::get<1>(server.MatchDocument("parrot"s, 500)), DocumentStatus::BANNED);
+
+    // Номер удалённого документа не переиспользуется, а тот же id можно добавить снова.
+    server.RemoveDocument(7);
+    server.AddDocument(7, "white owl"s, DocumentStatus::ACTUAL, {4});
+    ASSERT_EQUAL(server.GetDocumentCount(), 4);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("dog owl"s, 7)), (std::vector<std::string_view>{"owl"sv}));
+    try {
+        server.MatchDocument("owl"s, 8);
+        ASSERT_HINT(false, "Unknown document id must be rejected"s);
+    } catch (const std::out_of_range&) {
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_dense_ids.snapshot"s).string();
+    server.SaveSnapshot(path);
+    const SearchServer loaded = SearchServer::LoadSnapshot(path);
+    std::filesystem::remove(path);
+    SearchServer other("and in on"s);
+    other.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, {2});
+    const SearchServer merged = SearchServer::Merge({&loaded, &other}, {{42}, {}});
+
+    for (const SearchServer* copy : {&loaded, &merged}) {
+        ASSERT_EQUAL(copy->FindTopDocuments("owl"s)[0].id, 7);
+        ASSERT_EQUAL(copy->FindTopDocuments("parrot"s, DocumentStatus::BANNED)[0].rating, 9);
+        ASSERT_EQUAL(copy->GetWordFrequencies(1000000).size(), 2u);
+        ASSERT(copy->GetWordFrequencies(8).empty());
+    }
+    ASSERT_EQUAL(std::vector<int>(merged.cbegin(), merged.cend()), (std::vector<int>{3, 7, 500, 1000000}));
+    ASSERT_EQUAL(merged.FindTopDocuments("cat"s).size(), 2u);
+}
+
+void TestSnapshotRejectsCorruptPostings() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_corrupt_postings.snapshot"s).string();
+    {
+        SearchServer server(""s);
+        server.AddDocument(10, "cat"s, DocumentStatus::ACTUAL, {1});
+        server.AddDocument(20, "cat dog"s, DocumentStatus::ACTUAL, {2});
+        server.AddDocument(30, "dog"s, DocumentStatus::BANNED, {3});
+        server.AddDocument(40, "cat"s, DocumentStatus::ACTUAL, {4});
+        server.RemoveDocument(40);
+        server.SaveSnapshot(path);
+    }
+    std::vector<char> bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    SearchServer::LoadSnapshot(path);
+
+    const auto& header = *reinterpret_cast<const SnapshotHeader*>(bytes.data());
+    // Слова нумеруются по порядку появления: cat — 0, dog — 1.
+    const auto get_list = [&header](std::vector<char>& data, TermId term_id, DocumentStatus status) {
+        const auto* records = reinterpret_cast<const SnapshotPostingList*>(data.data() + header.postings_offset);
+        const SnapshotPostingList& record = records[term_id * DOCUMENT_STATUS_COUNT + static_cast<size_t>(status)];
+        auto* block = reinterpret_cast<PostingList::Block*>(data.data() + header.blocks_offset) + record.first_block;
+        uint8_t* values = reinterpret_cast<uint8_t*>(data.data() + header.posting_data_offset + record.data_offset + block->offset);
+        return std::pair(block, values);
+    };
+    const auto expect_rejected = [&path, &bytes](const auto& corrupt, const std::string& hint) {
+        std::vector<char> corrupted = bytes;
+        corrupt(corrupted);
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(corrupted.data(), corrupted.size());
+        }
+        try {
+            SearchServer::LoadSnapshot(path);
+            ASSERT_HINT(false, hint);
+        } catch (const std::invalid_argument&) {
+        }
+    };
+
+    // У cat среди актуальных документы 0 и 1: два управляющих байта,
+    // затем разность id, два числа вхождений и две длины, по байту на число.
+    expect_rejected([&](std::vector<char>& data) { get_list(data, 0, DocumentStatus::ACTUAL).second[2] = 0; },
+                    "Repeated posting id must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) { get_list(data, 0, DocumentStatus::ACTUAL).second[2] = 5; },
+                    "Posting id beyond its block must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) { get_list(data, 0, DocumentStatus::ACTUAL).second[5] = 0; },
+                    "Zero document length must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) {
+            const auto [block, values] = get_list(data, 0, DocumentStatus::ACTUAL);
+            block->last_document_id = 3;
+            values[2] = 3;
+        }, "Posting of a removed document must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) {
+            PostingList::Block* block = get_list(data, 1, DocumentStatus::ACTUAL).first;
+            block->first_document_id = block->last_document_id = 2;
+        }, "Posting of a document with another status must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) {
+            PostingList::Block* block = get_list(data, 1, DocumentStatus::BANNED).first;
+            block->first_document_id = block->last_document_id = 4;
+        }, "Posting id beyond the document columns must be rejected"s);
+
+    // Заниженные оценки сверху отсекли бы при поиске подходящие документы.
+    expect_rejected([&](std::vector<char>& data) { get_list(data, 0, DocumentStatus::ACTUAL).first->max_term_freq = 0.5; },
+                    "Understated block max term freq must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) {
+            auto* records = reinterpret_cast<SnapshotPostingList*>(data.data() + header.postings_offset);
+            records[0 * DOCUMENT_STATUS_COUNT + static_cast<size_t>(DocumentStatus::ACTUAL)].max_term_freq = 0.5;
+        }, "Understated list max term freq must be rejected"s);
+
+    // Постинги должны совпадать с прямым индексом.
+    expect_rejected([&](std::vector<char>& data) { get_list(data, 0, DocumentStatus::ACTUAL).second[6] = 3; },
+                    "Posting document length differing from the document must be rejected"s);
+    expect_rejected([&](std::vector<char>& data) { get_list(data, 0, DocumentStatus::ACTUAL).second[4] = 2; },
+                    "Posting term count differing from the forward index must be rejected"s);
+    // У dog среди актуальных один документ 1: управляющий байт, число
+    // вхождений и длина. Документ 0 слова dog не содержит, а его term_freq
+    // выше оценок списка, поэтому они тоже поднимаются.
+    expect_rejected([&](std::vector<char>& data) {
+            const auto [block, values] = get_list(data, 1, DocumentStatus::ACTUAL);
+            block->first_document_id = block->last_document_id = 0;
+            block->max_term_freq = 1.0;
+            values[2] = 1;
+            auto* records = reinterpret_cast<SnapshotPostingList*>(data.data() + header.postings_offset);
+            records[1 * DOCUMENT_STATUS_COUNT + static_cast<size_t>(DocumentStatus::ACTUAL)].max_term_freq = 1.0;
+        }, "Posting missing from the forward index must be rejected"s);
+    std::filesystem::remove(path);
+}
+
+void TestConcurrentMapInsertEraseAndRehash() {
+    // Один шард, чтобы все ключи попали в одну таблицу и она росла.
+    ConcurrentMap<int, int> map(1);
+    ASSERT_EQUAL(map.size(), 0u);
+    ASSERT(!map.Find(1).has_value());
+    ASSERT_EQUAL(map.erase(1), 0u);
+
+    for (int key = 0; key < 10000; ++key) {
+        map[key].ref_to_value = key * 2;
+    }
+    ASSERT_EQUAL(map.size(), 10000u);
+    for (int key = 0; key < 10000; ++key) {
+        ASSERT_EQUAL(map.Find(key).value_or(-1), key * 2);
+    }
+
+    for (int key = 0; key < 10000; key += 2) {
+        ASSERT_EQUAL(map.erase(key), 1u);
+    }
+    ASSERT_EQUAL(map.erase(0), 0u);
+    ASSERT_EQUAL(map.size(), 5000u);
+    for (int key = 0; key < 10000; ++key) {
+        ASSERT_EQUAL(map.Find(key).has_value(), key % 2 == 1);
+    }
+
+    // Удалённые ячейки занимаются снова, а поиск идёт сквозь них.
+    for (int round = 0; round < 20; ++round) {
+        for (int key = 0; key < 10000; key += 2) {
+            ASSERT_EQUAL(map[key].ref_to_value, 0);
+            map[key].ref_to_value = round;
+        }
+        for (int key = 0; key < 10000; key += 2) {
+            ASSERT_EQUAL(map.erase(key), 1u);
+        }
+    }
+    ASSERT_EQUAL(map.size(), 5000u);
+    for (int key = 1; key < 10000; key += 2) {
+        ASSERT_EQUAL(map.Find(key).value_or(-1), key * 2);
+    }
+
+    ConcurrentMap<std::string, std::string, std::hash<std::string>, std::shared_mutex> words(4);
+    words["cat"s].ref_to_value = "кот"s;
+    words["dog"s].ref_to_value = "пёс"s;
+    words.erase("cat"s);
+    words["parrot"s].ref_to_value += "попугай"s;
+    ASSERT(words.BuildOrdinaryMap() == (std::map<std::string, std::string>{{"dog"s, "пёс"s}, {"parrot"s, "попугай"s}}));
+}
+
+void TestConcurrentMapParallelUpdates() {
+    constexpr int THREAD_COUNT = 8;
+    constexpr int KEY_COUNT = 100;
+    constexpr int UPDATES_PER_THREAD = 20000;
+    ConcurrentMap<int, int64_t, std::hash<int>, SpinLock> map(16);
+
+    // Каждый вызов FetchAdd видит своё прежнее значение, так что
+    // прежние значения ключа — ровно 0, 1, ..., N - 1.
+    std::vector<std::vector<std::vector<int64_t>>> previous_values(THREAD_COUNT, std::vector<std::vector<int64_t>>(KEY_COUNT));
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < THREAD_COUNT; ++thread) {
+        threads.emplace_back([&map, &previous_values, thread] {
+            for (int i = 0; i < UPDATES_PER_THREAD; ++i) {
+                const int key = (i * 7 + thread) % KEY_COUNT;
+                previous_values[thread][key].push_back(map.FetchAdd(key, 1));
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQUAL(map.size(), static_cast<size_t>(KEY_COUNT));
+    for (int key = 0; key < KEY_COUNT; ++key) {
+        std::vector<int64_t> values;
+        for (const auto& thread_values : previous_values) {
+            values.insert(values.end(), thread_values[key].begin(), thread_values[key].end());
+        }
+        std::sort(values.begin(), values.end());
+        for (size_t i = 0; i < values.size(); ++i) {
+            ASSERT_EQUAL(values[i], static_cast<int64_t>(i));
+        }
+        ASSERT_EQUAL(map.Find(key).value_or(-1), static_cast<int64_t>(values.size()));
+    }
+
+    const auto sum_values = [](int64_t sum, int64_t value) { return sum + value; };
+    const auto get_value = [](int key, int64_t value) { return value; };
+    const int64_t total = int64_t{THREAD_COUNT} * UPDATES_PER_THREAD;
+    ASSERT_EQUAL(map.TransformReduce(int64_t{0}, sum_values, get_value), total);
+    ASSERT_EQUAL(map.TransformReduce(std::execution::par, int64_t{0}, sum_values, get_value), total);
+    ASSERT_EQUAL(map.TransformReduce(std::execution::par, int64_t{0}, sum_values, [](int key, int64_t) { return int64_t{key}; }),
+                 int64_t{KEY_COUNT} * (KEY_COUNT - 1) / 2);
+
+    map.ForEach(std::execution::par, [](int key, std::atomic<int64_t>& value) {
+        value = key;
+    });
+    std::atomic<int> visited = 0;
+    map.ForEach(std::execution::par, [&visited](int, std::atomic<int64_t>&) {
+        ++visited;
+    });
+    ASSERT_EQUAL(visited.load(), KEY_COUNT);
+    const std::map<int, int64_t> ordinary_map = map.BuildOrdinaryMap();
+    ASSERT_EQUAL(ordinary_map.size(), static_cast<size_t>(KEY_COUNT));
+    for (const auto& [key, value] : ordinary_map) {
+        ASSERT_EQUAL(value, static_cast<int64_t>(key));
+    }
+}
+
+void TestConcurrentMapAtomicValues() {
+    constexpr int THREAD_COUNT = 8;
+    constexpr int UPDATES_PER_THREAD = 20000;
+    // FetchAdd берёт разделяемую блокировку, а operator[] — исключительную,
+    // и изменения через оба пути не теряются.
+    ConcurrentMap<int, int64_t, std::hash<int>, std::shared_mutex> counters(4);
+    ConcurrentMap<int, double, std::hash<int>, std::shared_mutex> sums(4);
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < THREAD_COUNT; ++thread) {
+        threads.emplace_back([&counters, &sums, thread] {
+            for (int i = 0; i < UPDATES_PER_THREAD; ++i) {
+                if ((i + thread) % 4 == 0) {
+                    ++counters[i % 10].ref_to_value;
+                } else {
+                    counters.FetchAdd(i % 10, 1);
+                }
+                sums.FetchAdd(i % 3, 0.5);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const auto sum_values = [](auto sum, auto value) { return sum + value; };
+    const auto get_value = [](int, auto value) { return value; };
+    ASSERT_EQUAL(counters.TransformReduce(int64_t{0}, sum_values, get_value), int64_t{THREAD_COUNT} * UPDATES_PER_THREAD);
+    ASSERT_EQUAL(sums.TransformReduce(0.0, sum_values, get_value), 0.5 * THREAD_COUNT * UPDATES_PER_THREAD);
+    ASSERT_EQUAL(sums.FetchAdd(100, 2.5), 0.0);
+    ASSERT_EQUAL(sums.Find(100).value_or(-1.0), 2.5);
+}
+
 void TestSearchServer() {
     RUN_TEST(TestNoStopWords);
     RUN_TEST(TestAddingDocuments);
@@ -254,9 +1703,37 @@ void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestExcludeDocumentWithMinusWords);
     RUN_TEST(TestMatchingDocuments);
+    RUN_TEST(TestMatchedWordsOutliveQuery);
     RUN_TEST(TestSortingByRelevance);
     RUN_TEST(TestAveragingRating);
     RUN_TEST(TestFilteringByPredicat);
     RUN_TEST(TestFindDocumentsWithStatus);
     RUN_TEST(TestRelevanceCalculation);
+    RUN_TEST(TestRelevanceUpdatedAfterIndexChanges);
+    RUN_TEST(TestRemovingDocuments);
+    RUN_TEST(TestPrunedTopDocumentsMatchExhaustiveSearch);
+    RUN_TEST(TestPostingsKeptSortedOnOutOfOrderUpdates);
+    RUN_TEST(TestSnapshotRoundTrip);
+    RUN_TEST(TestAddingDocumentsInBatch);
+    RUN_TEST(TestMatchingDocumentsInBatch);
+    RUN_TEST(TestCompactionDropsDeadTerms);
+    RUN_TEST(TestReadersSeeConsistentVersions);
+    RUN_TEST(TestSegmentedIndexMatchesSingleIndex);
+    RUN_TEST(TestShardedIndexMatchesSingleIndex);
+    RUN_TEST(TestProcessQueriesOnExecutor);
+    RUN_TEST(TestProcessQueriesJoinedStreamsInOrder);
+    RUN_TEST(TestResultCacheFollowsIndexVersion);
+    RUN_TEST(TestTokenizerMatchesWordByWordSplit);
+    RUN_TEST(TestRemovingDuplicatesInBulk);
+    RUN_TEST(TestFindingNearDuplicates);
+    RUN_TEST(TestRequestQueueSlidingWindows);
+    RUN_TEST(TestQueryMetricsSnapshot);
+    RUN_TEST(TestQueryMetricsSkipFailedQueries);
+    RUN_TEST(TestBenchmarkWorkloadIsReproducible);
+    RUN_TEST(TestStatusPartitionsMatchFilteredSearch);
+    RUN_TEST(TestDenseInternalIdsKeepExternalIds);
+    RUN_TEST(TestSnapshotRejectsCorruptPostings);
+    RUN_TEST(TestConcurrentMapInsertEraseAndRehash);
+    RUN_TEST(TestConcurrentMapParallelUpdates);
+    RUN_TEST(TestConcurrentMapAtomicValues);
 }
\ No newline at end of file
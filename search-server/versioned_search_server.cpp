@@ -0,0 +1,31 @@
+#include "versioned_search_server.h"
+
+#include <atomic>
+
+VersionedSearchServer::VersionedSearchServer(SearchServer server)
+    : current_(std::make_shared<const SearchServer>(std::move(server)))
+{ }
+
+std::shared_ptr<const SearchServer> VersionedSearchServer::Acquire() const {
+    return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+}
+
+std::vector<std::exception_ptr> VersionedSearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    return Update([&documents](SearchServer& server) {
+        return server.AddDocuments(std::execution::par, documents);
+    });
+}
+
+void VersionedSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    Update([&document_ids](SearchServer& server) {
+        server.RemoveDocuments(std::execution::par, document_ids);
+    });
+}
+
+int VersionedSearchServer::GetDocumentCount() const {
+    return Acquire()->GetDocumentCount();
+}
+
+void VersionedSearchServer::Publish(std::shared_ptr<const SearchServer> next) {
+    std::atomic_store_explicit(&current_, std::move(next), std::memory_order_release);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <exception>
+#include <utility>
+#include <type_traits>
+
+#include "document.h"
+#include "search_server.h"
+
+// Поисковый сервер, который можно читать из многих потоков во время записи.
+// Текущая версия индекса — неизменяемый SearchServer за shared_ptr. Читатель
+// атомарно берёт указатель на версию и работает с ней сколько угодно долго,
+// не блокируя писателей и не видя их изменений. Писатель копирует текущую
+// версию, меняет копию и атомарно публикует её; старая версия освобождается,
+// когда её отпустит последний читатель.
+//
+// Каждая публикация копирует индекс целиком, поэтому писатели принимают
+// только пакеты изменений: AddDocuments, RemoveDocuments или Update.
+class VersionedSearchServer {
+public:
+    explicit VersionedSearchServer(SearchServer server);
+
+    // Неизменяемая версия индекса, актуальная на момент вызова.
+    std::shared_ptr<const SearchServer> Acquire() const;
+
+    // Применяет update к копии текущей версии и публикует её. Если update
+    // бросает исключение, опубликованная версия не меняется. Писатели
+    // выполняются по очереди.
+    template <typename Mutation>
+    auto Update(Mutation update);
+
+    std::vector<std::exception_ptr> AddDocuments(const std::vector<NewDocument>& documents);
+
+    // Бросает std::out_of_range, не меняя версию, если какого-то документа нет.
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const {
+        return Acquire()->FindTopDocuments(std::forward<Args>(args)...);
+    }
+
+    int GetDocumentCount() const;
+
+private:
+    std::shared_ptr<const SearchServer> current_;
+    std::mutex update_mutex_;
+
+    void Publish(std::shared_ptr<const SearchServer> next);
+};
+
+template <typename Mutation>
+auto VersionedSearchServer::Update(Mutation update) {
+    std::lock_guard guard(update_mutex_);
+    auto next = std::make_shared<SearchServer>(*Acquire());
+    if constexpr (std::is_void_v<std::invoke_result_t<Mutation&, SearchServer&>>) {
+        update(*next);
+        Publish(std::move(next));
+    } else {
+        auto result = update(*next);
+        Publish(std::move(next));
+        return result;
+    }
+}